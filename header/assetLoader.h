@@ -0,0 +1,46 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+/* Background loading of meshes, fields and other assets */
+// Every job parses its files on a thread of its own, so loading overlaps
+// with window and GL setup and with the other jobs.
+// poll() is called once per frame on the thread that owns the GL context;
+// it runs the upload step of every job whose loading has finished, so
+// GPU resources are only created there.
+// Until every job is uploaded, the tool shows getStatus(), e.g. in the
+// window title, instead of freezing.
+class AssetLoader {
+public:
+  /* Member functions */
+  void add(const std::string, std::function<void()>,
+           std::function<void()> = nullptr);
+  bool poll(); // true once every job is uploaded
+  void wait(); // until every job has loaded, without uploading
+  bool isDone() const { return nOfUploaded == jobs.size(); }
+  std::string getStatus() const;
+
+  /* Constructors */
+  AssetLoader()
+      : nOfUploaded(0), startTime(std::chrono::steady_clock::now()) {}
+  ~AssetLoader() {} // futures wait for their threads
+
+private:
+  typedef struct {
+    std::string name;
+    std::future<void> loaded;
+    std::function<void()> upload;
+    bool done;
+  } Job;
+
+  std::vector<Job> jobs;
+  size_t nOfUploaded;
+  std::chrono::steady_clock::time_point startTime;
+};
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <fstream>
+#include <vector>
+
+/* Helpers for binary files */
+// Values and arrays are written as they are in memory, so multi-byte
+// values are in the byte order of the machine. The readers return false
+// once the stream has failed, a short read included.
+template <class T> inline void writeRaw(std::ofstream &out, const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T> inline bool readRaw(std::ifstream &in, T &value) {
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+  return bool(in);
+}
+
+// the whole vector, its size is known to the reader
+template <class T>
+inline void writeArray(std::ofstream &out, const std::vector<T> &values) {
+  out.write(reinterpret_cast<const char *>(values.data()),
+            values.size() * sizeof(T));
+}
+
+// as many values as the vector holds
+template <class T>
+inline bool readArray(std::ifstream &in, std::vector<T> &values) {
+  in.read(reinterpret_cast<char *>(values.data()), values.size() * sizeof(T));
+  return bool(in);
+}
+
+#endif
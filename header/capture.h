@@ -0,0 +1,34 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "common.h"
+#include "frameWriter.h"
+
+/* Framebuffer capture without stalling the render loop */
+// glReadPixels into a pixel buffer object returns immediately; the copy
+// runs on the GPU. A frame is mapped and handed to the FrameWriter only
+// when its buffer comes around again in the ring, a few frames later,
+// by which time the transfer has finished.
+// Without pixel buffer objects, frames are read synchronously into the
+// writer's buffers, which still keeps encoding off the render thread.
+class FrameCapture {
+public:
+  /* Member functions */
+  void start(FrameWriter *, int = 3);
+  void capture();
+  void finish();
+
+  /* Constructors */
+  FrameCapture() : writer(nullptr), next(0), nOfPending(0) {}
+  ~FrameCapture() {}
+
+private:
+  void collect(int);
+
+  FrameWriter *writer;
+  vector<GLuint> pbos; // empty if not supported
+  int next;            // pbo the next frame is read into
+  int nOfPending;      // frames read but not collected yet
+};
+
+#endif
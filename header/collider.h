@@ -0,0 +1,60 @@
+#ifndef COLLIDER_H
+#define COLLIDER_H
+
+#include <algorithm>
+#include "sdf.h"
+
+/* A rigid, uniformly scaled instance of a shared distance field */
+// world = rotation * (local * scale) + translation
+// Many instances may point to the same Grid, the field is not copied.
+typedef struct {
+  const Grid *grid;
+  quat rotation;
+  vec3 translation;
+  float scale;
+
+  // derived from the transform
+  mat3 rot;                // rotation as a matrix
+  mat3 invRot;             // its inverse (transpose)
+  vec3 boundMin, boundMax; // world space aabb of the grid box
+} ColliderInstance;
+
+/* A scene of collider instances */
+// Queries transform points into the local frame of every instance whose
+// box contains them; the BVH culls all other instances.
+// Outside every instance the distance is 9999, as for a single Grid.
+class ColliderScene {
+public:
+  /* Members */
+  vector<ColliderInstance> instances;
+  vector<BvhNode> nodes;
+  vector<int> order; // instance indices, grouped by leaf
+
+  /* Member functions */
+  int addInstance(const Grid *, quat, vec3, float);
+  void setTransform(int, quat, vec3, float);
+  void build(); // after adding instances
+  void refit(); // after moving instances
+
+  float getDistance(vec3) const;
+  vec3 getGradient(vec3) const;
+
+  // same interface as Grid, so particles can collide with a scene
+  void getDistances(const float *, const float *, const float *, float *,
+                    int) const;
+  void getGradients(const float *, const float *, const float *, float *,
+                    float *, float *, int) const;
+  bool traceSegment(vec3, vec3, float, float &, vec3 &) const;
+  void getBounds(vec3 &, vec3 &) const;
+
+  /* Constructors */
+  ColliderScene() {}
+  ~ColliderScene() {}
+
+private:
+  int nearestInstance(vec3, float &) const;
+  int buildNode(int, int);
+  void refitNode(int);
+};
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef COMMON_H
+#define COMMON_H
+
 #include <iostream>
 #include <cstdlib>
 #include <ctime>
@@ -6,6 +9,8 @@
 #include <sstream>
 #include <cmath>
 #include <vector>
+#include <algorithm>
+#include <cstdint>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -16,6 +21,8 @@
 #include <GLFW/glfw3.h>
 #include <FreeImage.h>
 
+#include "particles.h"
+
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
 
@@ -38,11 +45,21 @@ typedef struct {
 /* Define a particle system */
 class Particles {
 public:
-  std::vector<Point> Ps;
+  ParticleSoA state; // owned by the simulation thread
   GLuint vao, vboPos, vboColor;
 
+  // position upload, see drawPoints
+  bool persistent;         // use a persistently mapped buffer if supported
+  GLfloat *mapped;         // 3 regions of capacity particles, or nullptr
+  size_t capacity;         // particles per region
+  int region;              // region written next
+  GLsync fences[3];        // set when the GPU may still read a region
+  vector<GLfloat> staging; // interleaved positions for the fallback
+
   /* Constructors */
-  Particles() {}
+  Particles()
+      : persistent(true), mapped(nullptr), capacity(0), region(0),
+        fences{0, 0, 0} {}
   ~Particles() {
     glDeleteBuffers(1, &vboPos);
     glDeleteBuffers(1, &vboColor);
@@ -66,21 +83,41 @@ public:
 
   // opengl data
   GLuint vboVtxs, vboUvs, vboNormals;
+  GLuint ebo;
   GLuint vao;
 
+  // indexed layout, filled by createMesh
+  // GPU vertices are the distinct (vertex, normal) pairs of the faces,
+  // sorted by vertex, so vertices[first, last) map to the contiguous GPU
+  // range [vtxStart[first], vtxStart[last])
+  std::vector<GLuint> vtxStart; // vertices.size() + 1 entries
+  GLsizei nOfIndices;
+
+  // rigid transform applied in the vertex shader, so moving the whole
+  // mesh does not touch the buffers
+  glm::mat4 model;
+
   // aabb
   glm::vec3 min, max;
 
   /* Constructors */
-  Mesh(){};
+  Mesh()
+      : vboVtxs(0), vboUvs(0), vboNormals(0), ebo(0), vao(0), nOfIndices(0),
+        model(1.f){};
   ~Mesh() {
+    // meshes parsed on a loader thread never touch GL
+    if (vao == 0) {
+      return;
+    }
     glDeleteBuffers(1, &vboVtxs);
     glDeleteBuffers(1, &vboUvs);
     glDeleteBuffers(1, &vboNormals);
+    glDeleteBuffers(1, &ebo);
     glDeleteVertexArrays(1, &vao);
   };
 
   /* Member functions */
+  // these change the vertices on the CPU, call updateMesh afterwards
   void translate(glm::vec3);
   void scale(glm::vec3);
   void rotate(glm::vec3);
@@ -97,7 +134,12 @@ GLint myGetUniformLocation(GLuint &, std::string);
 void findAABB(Mesh &);
 void drawBox(glm::vec3, glm::vec3);
 void updateMesh(Mesh &);
+void updateMesh(Mesh &, size_t, size_t);
+void drawMesh(Mesh &);
 void drawTriangle(Triangle &);
 void drawLine(vec3, vec3);
 void drawPoints(std::vector<Point> &);
-void drawPoints(Particles &);
+void drawPoints(Particles &, const FloatArray &, const FloatArray &,
+                const FloatArray &);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include "threadPool.h"
+
+/* Asynchronous writer of numbered BMP frames */
+// Frames live in a fixed set of reusable pixel buffers:
+//   acquire() -> fill the pixels -> submit()
+// Submitted frames wait in a bounded queue for a pool of encoder threads.
+// Encoders run in parallel, but files are written in frame order.
+// acquire() only waits when every buffer is queued or being encoded.
+// Pixels are 32 bit BGRA, rows bottom-up, as read by glReadPixels with
+// GL_BGRA and GL_UNSIGNED_INT_8_8_8_8_REV.
+class FrameWriter {
+public:
+  /* Member functions */
+  void start(const std::string, int, int, int = 2, int = 8);
+  int acquire();
+  uint8_t *getPixels(int);
+  void submit(int);
+  void finish();
+  bool isStarted() const { return !encoders.empty(); }
+
+  int width, height;
+
+  /* Statistics */
+  // read them after finish()
+  unsigned nOfWritten; // frames written
+  unsigned nOfStalls;  // acquires that had to wait for a free buffer
+
+  /* Constructors */
+  FrameWriter() : width(0), height(0), nOfWritten(0), nOfStalls(0) {}
+  ~FrameWriter() { finish(); }
+
+private:
+  void encoderLoop();
+
+  std::string prefix; // e.g. "./result/output" -> ./result/output0001.bmp
+  std::vector<std::vector<uint8_t>> buffers;
+  std::vector<unsigned> numbers; // frame number of each buffer
+  std::vector<int> freeList;     // buffers nobody uses
+  std::deque<int> queue;         // submitted, waiting for an encoder
+  unsigned nextNumber; // given to the next submitted frame
+  unsigned nextToWrite;
+  bool stopping;
+
+  std::vector<std::thread> encoders;
+  std::mutex mtx;
+  std::condition_variable notEmpty, notFull, turn;
+};
+
+std::string frameFileName(const std::string, unsigned);
+
+#endif
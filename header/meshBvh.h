@@ -0,0 +1,67 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include "common.h"
+
+/* Result of a closest point query */
+typedef struct {
+  float distance; // signed, same convention as distPoint2Triangle
+  vec3 point;     // closest point on the surface
+  vec3 bary;      // barycentric coordinates of point in the face
+  int face;       // index into Mesh::faces, -1 if nothing within range
+} MeshQuery;
+
+/* Exact distance queries against a triangle mesh */
+// The triangles are sorted into a bounding volume hierarchy built with
+// the surface area heuristic. A query descends depth first into the
+// nearer child first, which finds a close triangle early, and skips every
+// node further than the closest triangle found so far.
+// Unlike a Grid, the result is exact at every point.
+class MeshBvh {
+public:
+  /* Members */
+  vector<BvhNode> nodes;
+
+  /* Member functions */
+  void build(const Mesh &);
+  size_t size() const { return tris.size(); }
+
+  // after moving vertices of the same mesh: the tree is kept and only its
+  // boxes are updated, which is much cheaper than build() but lets the
+  // boxes grow looser as the mesh deforms further from the built shape
+  void refit(const Mesh &);
+
+  // triangles further than maxDist are ignored, which makes far queries
+  // cheap; outside the range the distance is 9999, as for a Grid
+  // A hint face, e.g. Grid::getFaceId of the point, is tested first;
+  // a good hint prunes almost the whole tree, the result stays exact.
+  MeshQuery query(vec3, float = 9999.f, int = -1) const;
+  void query(const vector<vec3> &, vector<MeshQuery> &,
+             float = 9999.f) const; // on the thread pool
+
+  // distance to one given face only, no search
+  MeshQuery queryFace(vec3, int) const;
+
+  // is any triangle within the radius? stops at the first one
+  bool isWithin(vec3, float) const;
+
+  /* Constructors */
+  MeshBvh() {}
+  ~MeshBvh() {}
+
+private:
+  typedef struct {
+    vec3 a, b, c; // counter-clockwise
+    vec3 n;       // surface normal
+    int face;     // index into Mesh::faces
+  } Tri;
+
+  int buildNode(int, int, vector<vec3> &);
+  void refitNode(int);
+  void testTriangle(const Tri &, vec3, float, MeshQuery &, float &) const;
+
+  vector<Tri> tris;      // grouped by leaf
+  vector<int> triOfFace; // index into tris of every face
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <new>
+#include <vector>
+#include "sdf.h"
+#include "threadPool.h"
+
+/* Allocator for SIMD friendly arrays */
+// every array starts on a cache line boundary
+template <class T> struct AlignedAllocator {
+  typedef T value_type;
+  static const size_t alignment = 64;
+
+  AlignedAllocator() {}
+  template <class U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(
+        ::operator new(n * sizeof(T), std::align_val_t(alignment)));
+  }
+  void deallocate(T *p, size_t) {
+    ::operator delete(p, std::align_val_t(alignment));
+  }
+
+  template <class U> bool operator==(const AlignedAllocator<U> &) const {
+    return true;
+  }
+  template <class U> bool operator!=(const AlignedAllocator<U> &) const {
+    return false;
+  }
+};
+
+typedef std::vector<float, AlignedAllocator<float>> FloatArray;
+
+/* Particle state in structure-of-arrays layout */
+// step() only touches positions and velocities,
+// so each attribute lives in its own contiguous array
+class ParticleSoA {
+public:
+  FloatArray x, y, z;    // position
+  FloatArray vx, vy, vz; // velocity
+  FloatArray m;          // mass
+
+  /* Member functions */
+  size_t size() const { return x.size(); }
+  void resize(size_t);
+  void add(vec3, vec3, float);
+  vec3 getPos(size_t) const;
+  vec3 getVelocity(size_t) const;
+
+  /* Constructors */
+  ParticleSoA() {}
+  ~ParticleSoA() {}
+};
+
+/* Simulation parameters */
+typedef struct {
+  float dt;
+  vec3 g;
+  float threshold; // distance at which collision response starts
+  float friction;  // velocity damping on collision
+
+  // particle-particle interaction, disabled if radius <= 0
+  float radius;    // particle radius
+  float stiffness; // repulsion per unit overlap
+  float damping;   // damping of the approaching relative velocity
+
+  // sphere trace each particle's motion instead of testing end points,
+  // so large time steps do not tunnel through thin parts
+  bool continuous;
+} SimParams;
+
+// Field is anything with the batched queries of Grid
+// instantiated for Grid, ColliderScene and SparseGrid in particles.cpp
+template <class Field>
+void stepParticles(ParticleSoA &, const Field &, const SimParams &, size_t,
+                   size_t);
+template <class Field>
+void stepParticlesParallel(ParticleSoA &, const Field &, const SimParams &,
+                           ThreadPool &);
+void loadParticles(ParticleSoA &, const string, vec3, unsigned);
+void writeParticles(const ParticleSoA &, const string);
+float hashRandf(unsigned, unsigned, unsigned);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include "particles.h"
+
+/* Binary trajectory format */
+// header  : magic "SDFR", version, nOfParticles, keyInterval,
+//           posQuantum, velQuantum
+// frames  : type (key or delta), step, payload size, payload
+// index   : file offset of every frame, nOfFrames, offset of the index,
+//           magic "SDFI"
+// Positions and velocities are quantized to multiples of a quantum.
+// Key frames store the quantized values, delta frames the difference to
+// the previous frame; both are zigzag varints, channel by channel, so
+// slowly moving particles cost one byte per value.
+// Every keyInterval-th frame is a key frame, so decoding any frame starts
+// from a key frame at most keyInterval - 1 frames before it.
+// Multi-byte values are stored in the byte order of the machine.
+
+/* Streaming recorder */
+// push() copies the particle state into a bounded ring of frames and
+// returns; a dedicated writer thread encodes the frames and writes them
+// to disk. push() only waits when the ring is full, i.e. when the disk is
+// slower than the simulation for longer than the ring can absorb.
+class Recorder {
+public:
+  /* Member functions */
+  bool open(const string, size_t, float = 1e-4f, float = 1e-3f, int = 30,
+            int = 8);
+  void push(const ParticleSoA &, unsigned);
+  void close();
+  bool isOpen() const { return writer.joinable(); }
+
+  /* Statistics */
+  // updated by the writer thread, read them after close()
+  unsigned nOfFrames; // frames written
+  unsigned nOfStalls; // pushes that had to wait for a free slot
+  uint64_t nOfBytes;  // bytes written
+
+  /* Constructors */
+  Recorder() : nOfFrames(0), nOfStalls(0), nOfBytes(0) {}
+  ~Recorder() { close(); }
+
+private:
+  typedef struct {
+    vector<float> data; // x, y, z, vx, vy, vz, each nOfParticles long
+    unsigned step;
+  } Slot;
+
+  void writerLoop();
+  void encode(const Slot &, bool);
+
+  ofstream file;
+  std::thread writer;
+  size_t nOfParticles;
+  float posQuantum, velQuantum;
+  int keyInterval;
+
+  // ring of frames, [tail, head) are waiting for the writer
+  vector<Slot> slots;
+  size_t head, tail;
+  bool stopping;
+  std::mutex mtx;
+  std::condition_variable notEmpty, notFull;
+
+  // writer thread only
+  vector<int32_t> prev;
+  vector<uint8_t> buffer;
+  vector<uint64_t> offsets;
+};
+
+/* Random access reader */
+class Replayer {
+public:
+  /* Member functions */
+  bool open(const string);
+  bool readFrame(unsigned, ParticleSoA &);
+  unsigned getStep(unsigned);
+  unsigned size() const { return unsigned(offsets.size()); }
+
+  size_t nOfParticles;
+  float posQuantum, velQuantum;
+  int keyInterval;
+
+  /* Constructors */
+  Replayer() : current(-1) {}
+  ~Replayer() {}
+
+private:
+  bool decodeNext(unsigned);
+
+  ifstream file;
+  vector<uint64_t> offsets;
+  vector<int32_t> values; // quantized values of frame current
+  vector<uint8_t> buffer;
+  int current;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RIGID_BODY_H
+#define RIGID_BODY_H
+
+#include "particles.h"
+
+/* Contact between a body vertex and the distance field */
+typedef struct {
+  vec3 point;  // world space vertex position
+  vec3 normal; // surface normal of the field, pointing outward
+  float depth; // signed distance, negative when penetrating
+} Contact;
+
+/* Contacts of all bodies, grouped by body */
+// body b owns contacts[start[b], start[b + 1])
+typedef struct {
+  vector<Contact> contacts;
+  vector<unsigned> start;
+} ContactList;
+
+/* Shape shared by any number of rigid bodies */
+// vertices are stored relative to the center of mass in SoA layout,
+// so they can be transformed and queried in blocks
+class RigidShape {
+public:
+  /* Members */
+  FloatArray x, y, z; // local vertex positions
+  vec3 center;        // center of mass in the input coordinates
+  float boundRadius;  // bounding sphere around the center of mass
+  float mass;         // total mass
+  mat3 invInertia;    // inverse inertia tensor in the local frame
+
+  /* Member functions */
+  void create(const vector<vec3> &, float);
+
+  /* Constructors */
+  RigidShape()
+      : center(0.f), boundRadius(0.f), mass(1.f), invInertia(1.f) {}
+  ~RigidShape() {}
+};
+
+/* Rigid body state */
+typedef struct {
+  int shape; // index into the shape array
+  vec3 pos;  // center of mass
+  quat rot;
+  vec3 v; // linear velocity
+  vec3 w; // angular velocity
+} RigidBody;
+
+/* Rigid body parameters */
+typedef struct {
+  float dt;
+  vec3 g;
+  float margin;      // contacts are generated below this distance
+  float restitution; // bounciness of the normal velocity
+  float friction;    // damping of the tangential velocity at a contact
+} RigidParams;
+
+// Field is Grid or ColliderScene, as for stepParticles
+template <class Field>
+void generateContacts(const vector<RigidBody> &, const vector<RigidShape> &,
+                      const Field &, float, ContactList &, ThreadPool &);
+void stepRigidBodies(vector<RigidBody> &, const vector<RigidShape> &,
+                     const ContactList &, const RigidParams &, ThreadPool &);
+
+#endif
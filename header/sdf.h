@@ -1,8 +1,13 @@
+#ifndef SDF_H
+#define SDF_H
+
 #include <iostream>
 #include <string>
 #include <vector>
 #include <ctime>
 #include <cstdlib>
+#include <fstream>
+#include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtx/compatibility.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -19,10 +24,22 @@ typedef struct {
   float sd;  // signed distance
 } Node, Cell;
 
+/* Node of a bounding volume hierarchy */
+// used over collider instances and over mesh triangles
+typedef struct {
+  vec3 min, max;
+  int left, right;  // children, -1 for a leaf
+  int first, count; // leaf items: [first, first + count) in the item order
+} BvhNode;
+
 class Grid {
 public:
   /* Members */
   vector<Cell> cells; // use hash to access each cell
+
+  // optional channel, one per cell: the face whose distance was taken,
+  // i.e. the closest face; empty if the generator did not record it
+  vector<int> faceIds;
   vec3 origin;
   float cellSize;
   ivec3 nOfCells;
@@ -33,15 +50,52 @@ public:
   vec3 getGradient(vec3);
   vec3 getGradient2(vec3);
   int calCellHash(vec3);
+  int getFaceId(vec3) const; // -1 if unknown
+
+  // batched queries on structure-of-arrays positions
+  void getDistances(const float *, const float *, const float *, float *,
+                    int) const;
+  void getGradients(const float *, const float *, const float *, float *,
+                    float *, float *, int) const;
+
+  // continuous collision detection along a segment
+  bool traceSegment(vec3, vec3, float, float &, vec3 &) const;
+
+  // box covered by the cells, distances are 9999 outside of it
+  void getBounds(vec3 &, vec3 &) const;
 
   /* Constructors */
   Grid() {}
   ~Grid() {}
 };
 
+/* A box of cells computed apart from the rest of a grid */
+// Shards of one grid may be computed by separate processes or machines
+// and merged afterwards, see mergeSdf.
+typedef struct {
+  uint64_t meshHash; // hashFile of the mesh, shards of one grid share it
+  ivec3 nOfCells;    // of the whole grid
+  vec3 origin;
+  float cellSize;
+  ivec3 lo, hi;        // the shard holds cells [lo, hi) of the grid
+  vector<float> sd;    // x fastest
+  vector<int> faceIds; // the closest face of every cell
+} Shard;
+
 vec2 lineUv(vec3, vec3, vec3);
 float signedArea(vec3, vec3, vec3);
 vec3 baryCoord(vec3, vec3, vec3, vec3, vec3);
 vec3 point2plane(vec3, vec3, vec3, vec3, vec3);
 float distPoint2Triangle(vec3, vec3, vec3, vec3, vec3);
+float sideSign(vec3, vec3, vec3);
+vec3 closestPoint2Triangle(vec3, vec3, vec3, vec3, vec3 &);
 int calCellHash(vec3, ivec3, float);
+void distanceTransform(Grid &, const vector<char> &);
+void writeSdf(Grid &, const string);
+void readSdf(Grid &, const string);
+void readSdfBatty(Grid &, const string);
+void writeShard(const Shard &, const string);
+bool readShard(Shard &, const string);
+void parallelFor(int, const function<void(int, int)> &);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SDF_CACHE_H
+#define SDF_CACHE_H
+
+#include "sdf.h"
+
+/* Content-addressed cache of fields */
+// A field is stored under a key hashed from everything it is made of: the
+// bytes of its source file and the parameters of the generator. Changing
+// the file or a parameter changes the key, so entries never go stale.
+// Entries are binary, a hit maps the file and copies the cells out of it
+// without parsing anything.
+// Entries are written to a temporary file and renamed, so a reader never
+// sees a partial entry, even with several processes sharing the cache.
+// When the cache outgrows its capacity, the least recently used entries
+// are removed; a hit counts as a use.
+class SdfCache {
+public:
+  /* Members */
+  string dir;
+  size_t capacity; // bytes
+
+  /* Member functions */
+  bool load(uint64_t, Grid &);
+  void store(uint64_t, const Grid &);
+  string calPath(uint64_t) const;
+
+  /* Constructors */
+  SdfCache(const string d = "./cache", size_t c = size_t(4) << 30)
+      : dir(d), capacity(c) {}
+  ~SdfCache() {}
+
+private:
+  void evict(const string &);
+};
+
+/* Keys */
+// FNV-1a, chained through seed
+static const uint64_t hashSeed = 14695981039346656037u;
+uint64_t hashBytes(const void *, size_t, uint64_t seed = hashSeed);
+uint64_t hashFile(const string, uint64_t seed = hashSeed);
+
+template <class T> uint64_t hashValue(const T &value, uint64_t seed) {
+  return hashBytes(&value, sizeof(T), seed);
+}
+
+// a reader of text fields in front of the cache, keyed by the file and tag
+void readSdfCached(Grid &, const string, void (*)(Grid &, const string),
+                   const string, SdfCache &);
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef SDF_CLIENT_H
+#define SDF_CLIENT_H
+
+#include <cstdint>
+#include "sdf.h"
+
+/* Protocol of sdfDaemon */
+// Requests and responses go over a Unix domain stream socket.
+// request  : type, field, count, then the payload of the type
+// response : status, count, then the payload of the type
+//   info      : -> FieldInfo
+//   distances : x[count], y[count], z[count] -> d[count]
+//   gradients : x[count], y[count], z[count] -> gx[], gy[], gz[]
+//   map       : -> FieldInfo, with a read-only descriptor of the shared
+//               memory of the field attached
+//   stats     : -> ClientStats of this connection
+// Status is 0, or negative for an unknown field, type or a count above
+// maxPoints. Queries give the same results as Grid::getDistances and
+// Grid::getGradients on the field.
+// Multi-byte values are in the byte order of the machine, the socket
+// never leaves it.
+enum {
+  requestInfo = 1,
+  requestDistances,
+  requestGradients,
+  requestMap,
+  requestStats
+};
+
+static const uint32_t maxPoints = 1 << 20; // per request
+
+typedef struct {
+  uint32_t type;
+  uint32_t field;
+  uint32_t count;
+} RequestHeader;
+
+typedef struct {
+  int32_t status;
+  uint32_t count;
+} ResponseHeader;
+
+typedef struct {
+  vec3 origin;
+  float cellSize;
+  ivec3 nOfCells;
+  uint32_t nOfFields; // served by the daemon
+  uint64_t size;      // bytes of the shared memory
+} FieldInfo;
+
+/* Latency statistics */
+// Latencies are counted in a histogram with 4 buckets per power of two of
+// microseconds, so percentiles are known to within 19% and the memory
+// stays the same however long a client runs.
+static const int nOfLatencyBuckets = 4 * 32 + 1;
+
+typedef struct {
+  uint64_t nOfRequests;
+  uint64_t nOfPoints;
+  uint64_t nOfCoalesced; // answered together with another client's request
+  double totalUs, maxUs;
+  uint32_t histogram[nOfLatencyBuckets];
+} ClientStats;
+
+void addLatency(ClientStats &, double);
+double calPercentile(const ClientStats &, double); // upper bound, in us
+
+/* A field in shared memory */
+// The daemon copies the distances of a grid into shared memory once, and
+// clients map it read-only to sample it without a round trip.
+// Only distances are stored, 4 bytes per cell instead of a whole Cell.
+class SharedField {
+public:
+  /* Members */
+  vec3 origin;
+  float cellSize;
+  ivec3 nOfCells;
+  const float *sd; // x fastest
+
+  /* Member functions */
+  bool create(const Grid &); // new shared memory, by the daemon
+  bool map(int);             // a descriptor from the daemon
+  int getReadOnlyFd() const { return roFd; }
+  size_t getSize() const { return size; }
+  FieldInfo getInfo() const;
+
+  // the same results as the functions of Grid
+  void getDistances(const float *, const float *, const float *, float *,
+                    int) const;
+  void getGradients(const float *, const float *, const float *, float *,
+                    float *, float *, int) const;
+  void getBounds(vec3 &, vec3 &) const;
+
+  /* Constructors */
+  SharedField() : sd(nullptr), base(nullptr), size(0), roFd(-1) {}
+  ~SharedField();
+  SharedField(const SharedField &) = delete;
+  SharedField &operator=(const SharedField &) = delete;
+
+private:
+  void *base;
+  size_t size;
+  int roFd; // kept by the daemon to hand out
+};
+
+/* Client */
+// One connection, to be used by one thread at a time.
+class SdfClient {
+public:
+  /* Member functions */
+  bool connect(const string);
+  void close();
+  bool getInfo(uint32_t, FieldInfo &);
+  bool getDistances(uint32_t, const float *, const float *, const float *,
+                    float *, int);
+  bool getGradients(uint32_t, const float *, const float *, const float *,
+                    float *, float *, float *, int);
+  bool mapField(uint32_t, SharedField &);
+  bool getStats(ClientStats &);
+
+  /* Constructors */
+  SdfClient() : fd(-1) {}
+  ~SdfClient() { close(); }
+
+private:
+  bool query(uint32_t, uint32_t, const float *, const float *,
+             const float *, float *, int);
+
+  int fd;
+  vector<float> buffer;
+};
+
+// whole messages, retried over short reads and writes
+bool sendAll(int, const void *, size_t);
+bool recvAll(int, void *, size_t);
+
+// a message with a descriptor attached, SCM_RIGHTS
+bool sendWithFd(int, const void *, size_t, int);
+bool recvWithFd(int, void *, size_t, int &);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SDF_UPDATE_H
+#define SDF_UPDATE_H
+
+#include "meshBvh.h"
+
+/* Incremental regeneration after a local mesh edit */
+// Only cells whose closest face may have changed are recomputed:
+//   - cells whose closest face was edited, so |d| was the distance to an
+//     edited face before the edit
+//   - cells an edited face may have come closer to, |d| > the distance
+//     to the edited faces after the edit
+// Both sets are found by flooding the grid outward from the edited faces
+// while the test holds, so the work follows the size of the edit and of
+// the region it affects, not the size of the grid.
+// Grid::faceIds narrows the first set down to the cells that referenced
+// an edited face or none (-1); without it, every cell passing the test is
+// recomputed.
+typedef struct {
+  int nOfVisited;    // cells tested
+  int nOfRecomputed; // cells queried against the mesh again
+  int nOfChanged;    // cells whose distance or face changed
+} SdfUpdate;
+
+// faces whose vertices moved, both meshes must have the same faces
+vector<int> findChangedFaces(const Mesh &, const Mesh &);
+void calFaceBounds(const Mesh &, const vector<int> &, vec3 &, vec3 &);
+
+// grid, mesh before and after the edit, bvh of the latter, changed faces
+SdfUpdate updateSdf(Grid &, const Mesh &, const Mesh &, const MeshBvh &,
+                    const vector<int> &);
+
+#endif
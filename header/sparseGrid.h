@@ -0,0 +1,73 @@
+#ifndef SPARSE_GRID_H
+#define SPARSE_GRID_H
+
+#include "sdf.h"
+
+/* Sparse signed distance field */
+// Cells are grouped into bricks of 8^3. Only bricks near the surface are
+// allocated and store a distance per cell, so memory grows with the area
+// of the surface instead of the volume of the box.
+// The brick index is two-level: a dense array with one entry per brick,
+// holding the number of its allocated brick or -1, and a coarse signed
+// value per brick. Every cell of an unallocated brick reads as that coarse
+// value, a lower bound of |d| over the brick with the sign of its side, so
+// sphere tracing through it never oversteps.
+// At 2048^3 cells the index costs 128 MB, and every allocated brick 2 KB.
+// Queries follow Grid: the cell containing the point, 9999 outside the box.
+class SparseGrid {
+public:
+  static const int brickShift = 3;
+  static const int brickSize = 1 << brickShift; // cells per axis
+  static const int brickVolume = brickSize * brickSize * brickSize;
+
+  /* Members */
+  vec3 origin;
+  float cellSize;
+  ivec3 nOfCells;
+  ivec3 nOfBricks;
+  float band; // every cell with |d| <= band is in an allocated brick
+
+  vector<int> index;    // per brick: allocated brick number, or -1
+  vector<float> coarse; // per brick: signed lower bound of |d|
+  vector<float> bricks; // brickVolume distances per allocated brick
+
+  /* Member functions */
+  void init(vec3, float, ivec3, float);
+  int allocate(int); // by brick hash, cells start at the coarse value
+  float *getBrick(int n) { return bricks.data() + size_t(n) * brickVolume; }
+  size_t nOfAllocated() const { return bricks.size() / brickVolume; }
+  size_t memory() const; // bytes
+
+  int calBrickHash(ivec3 b) const {
+    return b.x + nOfBricks.x * (b.y + nOfBricks.y * b.z);
+  }
+
+  float getDistance(vec3) const;
+  vec3 getGradient(vec3) const;
+
+  // same interface as Grid, so particles can collide with it
+  void getDistances(const float *, const float *, const float *, float *,
+                    int) const;
+  void getGradients(const float *, const float *, const float *, float *,
+                    float *, float *, int) const;
+  bool traceSegment(vec3, vec3, float, float &, vec3 &) const;
+  void getBounds(vec3 &, vec3 &) const;
+
+  /* Constructors */
+  SparseGrid() : cellSize(0.f), band(0.f), version(0) {}
+  ~SparseGrid() {}
+
+private:
+  float lookup(ivec3, bool &) const;
+
+  // changes whenever bricks move, so a brick pointer cached by a thread
+  // for another field, or before a reallocation, is never used
+  unsigned version;
+  void touch();
+};
+
+// binary, see sparseGrid.cpp
+void writeSparseSdf(const SparseGrid &, const string);
+bool readSparseSdf(SparseGrid &, const string);
+
+#endif
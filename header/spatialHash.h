@@ -0,0 +1,117 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <atomic>
+#include <memory>
+#include "particles.h"
+
+/* Uniform spatial hash over particles */
+// Space is divided into cubic cells, and each cell is hashed into one of
+// tableSize buckets. Particle indices are counting-sorted by bucket, so
+// the particles of a bucket are contiguous in sorted[].
+// Buffers only grow, so rebuilding every step does not allocate once the
+// particle count is stable.
+class SpatialHash {
+public:
+  /* Members */
+  float cellSize;
+  size_t tableSize;           // power of two
+  vector<unsigned> cellStart; // bucket b is sorted[cellStart[b], [b + 1])
+  vector<unsigned> sorted;    // particle indices sorted by bucket
+  vector<unsigned> keys;      // bucket of each particle
+  FloatArray dvx, dvy, dvz;   // scratch for collideParticles
+
+  /* Member functions */
+  void build(const ParticleSoA &, float, ThreadPool &);
+  unsigned calBucket(ivec3) const;
+  ivec3 calCellIdx(vec3) const;
+
+  // call func(j) for every particle j != i within radius of particle i
+  // cost is proportional to the number of particles in the 27 cells
+  // around i, so a query over all particles is O(n)
+  template <class F>
+  void forEachNeighbor(const ParticleSoA &, size_t, float, F) const;
+
+  /* Constructors */
+  SpatialHash() : cellSize(1.f), tableSize(0) {}
+  ~SpatialHash() {}
+
+private:
+  std::unique_ptr<std::atomic<unsigned>[]> counts;
+  vector<unsigned> blockSums;
+};
+
+// soft repulsion between overlapping particles
+void collideParticles(ParticleSoA &, SpatialHash &, const SimParams &,
+                      ThreadPool &);
+
+inline ivec3 SpatialHash::calCellIdx(vec3 p) const {
+  return ivec3(floor(p / cellSize));
+}
+
+// spread the lower 10 bits of v so that there are two zeros between bits
+static inline unsigned spreadBits(unsigned v) {
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+// Morton (z-order) code of the cell, wrapped to the table size
+// Nearby cells get nearby buckets, so walking the particles in bucket
+// order keeps neighbor lookups in cache. Cells that are 2^10 cells apart
+// along an axis may share a bucket; queries check the real distance.
+inline unsigned SpatialHash::calBucket(ivec3 idx) const {
+  unsigned h = spreadBits(unsigned(idx.x)) |
+               (spreadBits(unsigned(idx.y)) << 1) |
+               (spreadBits(unsigned(idx.z)) << 2);
+
+  return h & unsigned(tableSize - 1);
+}
+
+template <class F>
+void SpatialHash::forEachNeighbor(const ParticleSoA &ps, size_t i,
+                                  float radius, F func) const {
+  vec3 p = ps.getPos(i);
+  ivec3 center = calCellIdx(p);
+  float r2 = radius * radius;
+
+  // different cells may share a bucket, visit each bucket once
+  unsigned visited[27];
+  int nOfVisited = 0;
+
+  for (int dz = -1; dz <= 1; dz++) {
+    for (int dy = -1; dy <= 1; dy++) {
+      for (int dx = -1; dx <= 1; dx++) {
+        unsigned b = calBucket(center + ivec3(dx, dy, dz));
+
+        bool seen = false;
+        for (int k = 0; k < nOfVisited; k++) {
+          seen = seen || (visited[k] == b);
+        }
+        if (seen) {
+          continue;
+        }
+        visited[nOfVisited++] = b;
+
+        for (unsigned s = cellStart[b]; s < cellStart[b + 1]; s++) {
+          unsigned j = sorted[s];
+          if (j == i) {
+            continue;
+          }
+
+          float ex = ps.x[j] - p.x;
+          float ey = ps.y[j] - p.y;
+          float ez = ps.z[j] - p.z;
+          if (ex * ex + ey * ey + ez * ez < r2) {
+            func(j);
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* A persistent pool of worker threads */
+// Threads are created once and sleep between jobs, so running a parallel
+// loop every frame costs a wake-up instead of a thread creation.
+// The calling thread takes part in the work as well.
+class ThreadPool {
+public:
+  /* Member functions */
+  // call func(begin, end) on chunks of [0, n), in parallel
+  // returns when every chunk is done
+  void parallelFor(size_t, size_t,
+                   const std::function<void(size_t, size_t)> &);
+  int size() const { return int(workers.size()) + 1; }
+
+  /* Constructors */
+  // nOfThreads <= 0 uses every hardware thread
+  ThreadPool(int nOfThreads = 0);
+  ~ThreadPool();
+
+private:
+  void workerLoop();
+  void runChunks();
+
+  std::vector<std::thread> workers;
+  std::mutex mtx, dispatchMtx;
+  std::condition_variable wake, done;
+
+  // current job
+  const std::function<void(size_t, size_t)> *job;
+  size_t jobSize, jobChunk;
+  std::atomic<size_t> nextChunk;
+  int nOfActive;
+  unsigned generation;
+  bool stopping;
+};
+
+// pool shared by the whole process
+ThreadPool &getThreadPool();
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/* Lock-free handoff of the latest value between two threads */
+// One producer and one consumer each own a slot; the third slot is in
+// the middle. The producer fills its back slot and swaps it with the
+// middle one; the consumer swaps its front slot with the middle one when
+// that holds something new. Neither side ever waits, the consumer simply
+// skips values that were replaced before it looked.
+template <class T> class TripleBuffer {
+public:
+  /* Member functions */
+  // producer
+  T &getBack() { return slots[back]; }
+  void publish() {
+    back = middle.exchange(back | freshBit, std::memory_order_acq_rel) &
+           indexMask;
+  }
+
+  // consumer, returns false if nothing was published since the last call
+  bool consume() {
+    if (!(middle.load(std::memory_order_relaxed) & freshBit)) {
+      return false;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+    return true;
+  }
+  const T &getFront() const { return slots[front]; }
+
+  /* Constructors */
+  TripleBuffer() : back(0), front(1), middle(2) {}
+  ~TripleBuffer() {}
+
+private:
+  static const int freshBit = 4;
+  static const int indexMask = 3;
+
+  T slots[3];
+  int back, front;         // owned by the producer and the consumer
+  std::atomic<int> middle; // slot index, plus freshBit if not consumed
+};
+
+#endif
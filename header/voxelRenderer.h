@@ -0,0 +1,52 @@
+#ifndef VOXEL_RENDERER_H
+#define VOXEL_RENDERER_H
+
+#include "common.h"
+#include "sdf.h"
+
+/* Instanced drawing of the cells inside a distance field */
+// A cell is shown if its distance is below the isovalue and its position
+// along z is below the slice. Only cells with a hidden neighbor are kept,
+// the others cannot be seen, so the cost follows the surface area instead
+// of the volume.
+// The cells are grouped into chunks of chunkSize^3 cells. Every chunk owns
+// a contiguous range of the instance buffer, so chunks outside the view
+// frustum are skipped on the CPU and the rest is drawn in a few runs.
+// The buffer is only rebuilt by build(), i.e. when the isovalue or the
+// slice changes, not every frame.
+class VoxelRenderer {
+public:
+  /* Member functions */
+  void init();
+  void build(const Grid &, float, float);
+  void draw(const mat4 &); // projection * view
+  size_t size() const { return offsets.size() / 3; }
+
+  int nOfDrawnChunks; // chunks that passed the culling in the last draw
+
+  /* Constructors */
+  VoxelRenderer()
+      : nOfDrawnChunks(0), vao(0), vboCube(0), vboInstances(0),
+        capacity(0) {}
+  ~VoxelRenderer() {
+    glDeleteBuffers(1, &vboCube);
+    glDeleteBuffers(1, &vboInstances);
+    glDeleteVertexArrays(1, &vao);
+  }
+
+  static const int chunkSize = 16;
+
+private:
+  typedef struct {
+    vec3 min, max; // box of the cubes
+    GLint first;   // first instance
+    GLsizei count; // number of instances
+  } Chunk;
+
+  vector<Chunk> chunks;    // non-empty chunks in buffer order
+  vector<GLfloat> offsets; // cell positions, 3 per instance
+  GLuint vao, vboCube, vboInstances;
+  size_t capacity; // instances the buffer can hold
+};
+
+#endif
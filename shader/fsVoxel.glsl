@@ -0,0 +1,12 @@
+#version 330
+in vec3 normal;
+out vec4 outColor;
+
+uniform vec3 lightPos;
+
+void main(){
+    // light from a fixed direction, so the faces of a cube differ
+    float kd = abs(dot(normal, normalize(lightPos)));
+
+    outColor = vec4( vec3(0.5) * (0.3 + 0.7 * kd), 1.0 );
+}
@@ -0,0 +1,13 @@
+#version 330
+layout( location = 0 ) in vec3 vtxCoord;
+layout( location = 1 ) in vec3 offset; // one per instance
+layout( location = 2 ) in vec3 vtxNormal;
+
+uniform mat4 M, V, P;
+
+out vec3 normal;
+
+void main(){
+    gl_Position = P * V * M * vec4( vtxCoord + offset, 1.0 );
+    normal = vtxNormal;
+}
@@ -0,0 +1,65 @@
+#include "assetLoader.h"
+#include <iostream>
+#include <sstream>
+
+// load runs on a new thread right away, upload later in poll()
+void AssetLoader::add(const std::string name, std::function<void()> load,
+                      std::function<void()> upload) {
+  Job job;
+  job.name = name;
+  job.loaded = std::async(std::launch::async, load);
+  job.upload = upload;
+  job.done = false;
+
+  jobs.push_back(std::move(job));
+}
+
+bool AssetLoader::poll() {
+  for (Job &job : jobs) {
+    if (job.done || job.loaded.wait_for(std::chrono::seconds(0)) !=
+                        std::future_status::ready) {
+      continue;
+    }
+
+    job.loaded.get();
+    if (job.upload) {
+      job.upload();
+    }
+    job.done = true;
+    nOfUploaded++;
+
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - startTime;
+    std::cout << "loaded " << job.name << " after " << elapsed.count()
+              << " s" << '\n';
+  }
+
+  return isDone();
+}
+
+// e.g. when the window is closed during loading, the loading threads may
+// still be writing the assets and must finish before anything is released
+void AssetLoader::wait() {
+  for (Job &job : jobs) {
+    if (!job.done) {
+      job.loaded.wait();
+    }
+  }
+}
+
+// e.g. "loading bunny.obj, sdfBunnyBatty.txt (1/3)"
+std::string AssetLoader::getStatus() const {
+  std::ostringstream status;
+  status << "loading";
+
+  const char *separator = " ";
+  for (const Job &job : jobs) {
+    if (!job.done) {
+      status << separator << job.name;
+      separator = ", ";
+    }
+  }
+  status << " (" << nOfUploaded << "/" << jobs.size() << ")";
+
+  return status.str();
+}
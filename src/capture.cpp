@@ -0,0 +1,89 @@
+#include <cstring>
+#include "capture.h"
+
+/* Member functions of FrameCapture */
+// captures frames of writer->width x writer->height pixels
+// nOfPbos frames are in flight before the oldest one is collected
+void FrameCapture::start(FrameWriter *frameWriter, int nOfPbos) {
+  writer = frameWriter;
+  next = 0;
+  nOfPending = 0;
+
+  pbos.clear();
+  if (!GLEW_VERSION_2_1) {
+    return;
+  }
+
+  GLsizeiptr size = GLsizeiptr(writer->width) * writer->height * 4;
+  pbos.resize(std::max(nOfPbos, 1));
+  glGenBuffers(GLsizei(pbos.size()), pbos.data());
+
+  for (size_t i = 0; i < pbos.size(); i++) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+// read the current framebuffer
+void FrameCapture::capture() {
+  int w = writer->width;
+  int h = writer->height;
+
+  // fallback, synchronous read
+  if (pbos.empty()) {
+    int b = writer->acquire();
+    glReadPixels(0, 0, w, h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+                 (GLvoid *)writer->getPixels(b));
+    writer->submit(b);
+    return;
+  }
+
+  // the ring is full, the oldest frame sits in the pbo about to be reused
+  if (nOfPending == int(pbos.size())) {
+    collect(next);
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[next]);
+  glReadPixels(0, 0, w, h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  next = (next + 1) % int(pbos.size());
+  nOfPending++;
+}
+
+// copy a finished transfer to the writer
+// A frame whose buffer cannot be mapped is dropped rather than written
+// with whatever the writer's buffer held before.
+void FrameCapture::collect(int i) {
+  size_t size = size_t(writer->width) * writer->height * 4;
+  nOfPending--;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+  void *src = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (!src) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    std::cout << "failed to map the pixel buffer, frame dropped" << std::endl;
+    return;
+  }
+
+  int b = writer->acquire();
+  std::memcpy(writer->getPixels(b), src, size);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  writer->submit(b);
+}
+
+// collect the frames still in flight, oldest first, and release the pbos
+void FrameCapture::finish() {
+  int n = int(pbos.size());
+  while (nOfPending > 0) {
+    collect((next - nOfPending + n) % n);
+  }
+
+  if (n > 0) {
+    glDeleteBuffers(GLsizei(n), pbos.data());
+    pbos.clear();
+  }
+}
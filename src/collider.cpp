@@ -0,0 +1,290 @@
+#include "collider.h"
+
+/* Member functions of ColliderScene */
+int ColliderScene::addInstance(const Grid *grid, quat rotation,
+                               vec3 translation, float scale) {
+  ColliderInstance inst;
+  inst.grid = grid;
+  instances.push_back(inst);
+
+  int id = int(instances.size()) - 1;
+  setTransform(id, rotation, translation, scale);
+
+  return id;
+}
+
+// update the transform and the world space box of an instance
+// call refit() once all instances of a frame have been moved
+void ColliderScene::setTransform(int id, quat rotation, vec3 translation,
+                                 float scale) {
+  ColliderInstance &inst = instances[id];
+  inst.rotation = normalize(rotation);
+  inst.translation = translation;
+  inst.scale = scale;
+  inst.rot = mat3_cast(inst.rotation);
+  inst.invRot = transpose(inst.rot);
+
+  // transform the 8 corners of the grid box
+  const Grid &gd = *inst.grid;
+  vec3 size = vec3(gd.nOfCells) * gd.cellSize;
+
+  inst.boundMin = vec3(9999.f);
+  inst.boundMax = vec3(-9999.f);
+  for (int c = 0; c < 8; c++) {
+    vec3 corner = gd.origin + size * vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+    vec3 world = inst.rot * (corner * scale) + translation;
+    inst.boundMin = min(inst.boundMin, world);
+    inst.boundMax = max(inst.boundMax, world);
+  }
+}
+
+// top-down build, median split along the longest axis of the centers
+void ColliderScene::build() {
+  nodes.clear();
+  order.resize(instances.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = int(i);
+  }
+
+  if (!instances.empty()) {
+    buildNode(0, int(order.size()));
+  }
+}
+
+int ColliderScene::buildNode(int first, int count) {
+  int id = int(nodes.size());
+  nodes.push_back(BvhNode());
+
+  // bounds of the instances and of their centers
+  vec3 bmin(9999.f), bmax(-9999.f), cmin(9999.f), cmax(-9999.f);
+  for (int i = first; i < first + count; i++) {
+    const ColliderInstance &inst = instances[order[i]];
+    vec3 center = 0.5f * (inst.boundMin + inst.boundMax);
+    bmin = min(bmin, inst.boundMin);
+    bmax = max(bmax, inst.boundMax);
+    cmin = min(cmin, center);
+    cmax = max(cmax, center);
+  }
+
+  nodes[id].min = bmin;
+  nodes[id].max = bmax;
+  nodes[id].first = first;
+  nodes[id].count = count;
+  nodes[id].left = -1;
+  nodes[id].right = -1;
+
+  const int leafSize = 2;
+  if (count <= leafSize) {
+    return id;
+  }
+
+  vec3 extent = cmax - cmin;
+  int axis = 0;
+  if (extent.y > extent[axis]) {
+    axis = 1;
+  }
+  if (extent.z > extent[axis]) {
+    axis = 2;
+  }
+
+  int half = count / 2;
+  std::nth_element(order.begin() + first, order.begin() + first + half,
+                   order.begin() + first + count, [&](int a, int b) {
+                     const ColliderInstance &ia = instances[a];
+                     const ColliderInstance &ib = instances[b];
+                     return ia.boundMin[axis] + ia.boundMax[axis] <
+                            ib.boundMin[axis] + ib.boundMax[axis];
+                   });
+
+  int left = buildNode(first, half);
+  int right = buildNode(first + half, count - half);
+  nodes[id].left = left;
+  nodes[id].right = right;
+
+  return id;
+}
+
+// keep the tree, update the boxes bottom-up
+// cheap enough to run every frame for moving instances
+void ColliderScene::refit() {
+  if (nodes.size() > 0) {
+    refitNode(0);
+  }
+}
+
+void ColliderScene::refitNode(int id) {
+  BvhNode &node = nodes[id];
+
+  if (node.left < 0) {
+    node.min = vec3(9999.f);
+    node.max = vec3(-9999.f);
+    for (int i = node.first; i < node.first + node.count; i++) {
+      node.min = min(node.min, instances[order[i]].boundMin);
+      node.max = max(node.max, instances[order[i]].boundMax);
+    }
+    return;
+  }
+
+  refitNode(node.left);
+  refitNode(node.right);
+  node.min = min(nodes[node.left].min, nodes[node.right].min);
+  node.max = max(nodes[node.left].max, nodes[node.right].max);
+}
+
+// index of the instance closest to p among those whose box contains p,
+// -1 if there is none
+int ColliderScene::nearestInstance(vec3 p, float &dist) const {
+  dist = 9999.f;
+  int nearest = -1;
+
+  if (nodes.empty()) {
+    return nearest;
+  }
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    const BvhNode &node = nodes[stack[--top]];
+
+    if (p.x < node.min.x || p.y < node.min.y || p.z < node.min.z ||
+        p.x > node.max.x || p.y > node.max.y || p.z > node.max.z) {
+      continue;
+    }
+
+    if (node.left >= 0) {
+      stack[top++] = node.left;
+      stack[top++] = node.right;
+      continue;
+    }
+
+    for (int i = node.first; i < node.first + node.count; i++) {
+      const ColliderInstance &inst = instances[order[i]];
+
+      // to the local frame of the instance
+      vec3 local = inst.invRot * (p - inst.translation) / inst.scale;
+
+      float d;
+      inst.grid->getDistances(&local.x, &local.y, &local.z, &d, 1);
+      if (d >= 9999.f) {
+        continue;
+      }
+
+      d *= inst.scale;
+      if (d < dist) {
+        dist = d;
+        nearest = order[i];
+      }
+    }
+  }
+
+  return nearest;
+}
+
+float ColliderScene::getDistance(vec3 p) const {
+  float dist;
+  nearestInstance(p, dist);
+
+  return dist;
+}
+
+// gradient of the nearest instance, in world space
+vec3 ColliderScene::getGradient(vec3 p) const {
+  float dist;
+  int id = nearestInstance(p, dist);
+  if (id < 0) {
+    return vec3(0.f);
+  }
+
+  const ColliderInstance &inst = instances[id];
+  vec3 local = inst.invRot * (p - inst.translation) / inst.scale;
+
+  vec3 n;
+  inst.grid->getGradients(&local.x, &local.y, &local.z, &n.x, &n.y, &n.z, 1);
+
+  return inst.rot * n;
+}
+
+void ColliderScene::getDistances(const float *px, const float *py,
+                                 const float *pz, float *out, int n) const {
+  for (int i = 0; i < n; i++) {
+    out[i] = getDistance(vec3(px[i], py[i], pz[i]));
+  }
+}
+
+void ColliderScene::getGradients(const float *px, const float *py,
+                                 const float *pz, float *gx, float *gy,
+                                 float *gz, int n) const {
+  for (int i = 0; i < n; i++) {
+    vec3 g = getGradient(vec3(px[i], py[i], pz[i]));
+    gx[i] = g.x;
+    gy[i] = g.y;
+    gz[i] = g.z;
+  }
+}
+
+// union of the instance boxes, empty before build()
+void ColliderScene::getBounds(vec3 &boxMin, vec3 &boxMax) const {
+  if (nodes.empty()) {
+    boxMin = vec3(9999.f);
+    boxMax = vec3(-9999.f);
+    return;
+  }
+
+  boxMin = nodes[0].min;
+  boxMax = nodes[0].max;
+}
+
+// sphere trace the segment through every instance whose box it overlaps
+// the travelled fraction does not change under a similarity transform,
+// so each instance is traced in its own frame and the earliest hit wins
+bool ColliderScene::traceSegment(vec3 p0, vec3 p1, float radius, float &toi,
+                                 vec3 &normal) const {
+  bool hit = false;
+  toi = 1.f;
+
+  if (nodes.empty()) {
+    return false;
+  }
+
+  vec3 segMin = min(p0, p1) - vec3(radius);
+  vec3 segMax = max(p0, p1) + vec3(radius);
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0) {
+    const BvhNode &node = nodes[stack[--top]];
+
+    if (segMax.x < node.min.x || segMax.y < node.min.y ||
+        segMax.z < node.min.z || segMin.x > node.max.x ||
+        segMin.y > node.max.y || segMin.z > node.max.z) {
+      continue;
+    }
+
+    if (node.left >= 0) {
+      stack[top++] = node.left;
+      stack[top++] = node.right;
+      continue;
+    }
+
+    for (int i = node.first; i < node.first + node.count; i++) {
+      const ColliderInstance &inst = instances[order[i]];
+      vec3 l0 = inst.invRot * (p0 - inst.translation) / inst.scale;
+      vec3 l1 = inst.invRot * (p1 - inst.translation) / inst.scale;
+
+      float t;
+      vec3 n;
+      if (inst.grid->traceSegment(l0, l1, radius / inst.scale, t, n) &&
+          t <= toi) {
+        hit = true;
+        toi = t;
+        normal = inst.rot * n;
+      }
+    }
+  }
+
+  return hit;
+}
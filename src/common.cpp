@@ -344,68 +344,70 @@ void drawBox(glm::vec3 min, glm::vec3 max) {
   glDeleteVertexArrays(1, &vao);
 }
 
-void createMesh(Mesh &mesh) {
-  // write vertex coordinate to array
-  int nOfFaces = mesh.faces.size();
+// Positions of the GPU vertices of mesh.vertices[first, last)
+static void gatherPositions(const Mesh &mesh, size_t first, size_t last,
+                            vector<GLfloat> &aVtxCoords) {
+  aVtxCoords.resize((mesh.vtxStart[last] - mesh.vtxStart[first]) * 3);
+
+  size_t k = 0;
+  for (size_t v = first; v < last; v++) {
+    // one copy per distinct normal of the vertex
+    for (GLuint g = mesh.vtxStart[v]; g < mesh.vtxStart[v + 1]; g++) {
+      aVtxCoords[k++] = mesh.vertices[v].x;
+      aVtxCoords[k++] = mesh.vertices[v].y;
+      aVtxCoords[k++] = mesh.vertices[v].z;
+    }
+  }
+}
 
-  // 3 vertices per face, 3 float per vertex coord, 2 float per tex coord
-  GLfloat *aVtxCoords = new GLfloat[nOfFaces * 3 * 3];
-  // GLfloat *aUvs = new GLfloat[nOfFaces * 3 * 2];
-  GLfloat *aNormals = new GLfloat[nOfFaces * 3 * 3];
+// Build an indexed vertex buffer from the faces.
+// Corners with the same vertex and normal share one GPU vertex; the faces
+// become 3 indices each in an element buffer. Draw with drawMesh.
+void createMesh(Mesh &mesh) {
+  size_t nOfVtxs = mesh.vertices.size();
+  size_t nOfFaces = mesh.faces.size();
 
+  // (vertex, normal) of every corner, vertex in the high bits
+  vector<uint64_t> corners(nOfFaces * 3);
   for (size_t i = 0; i < nOfFaces; i++) {
-    // vertex 1
-    int vtxIdx = mesh.faces[i].v1;
-    aVtxCoords[i * 9 + 0] = mesh.vertices[vtxIdx].x;
-    aVtxCoords[i * 9 + 1] = mesh.vertices[vtxIdx].y;
-    aVtxCoords[i * 9 + 2] = mesh.vertices[vtxIdx].z;
-
-    // normal for vertex 1
-    int nmlIdx = mesh.faces[i].vn1;
-    aNormals[i * 9 + 0] = mesh.faceNormals[nmlIdx].x;
-    aNormals[i * 9 + 1] = mesh.faceNormals[nmlIdx].y;
-    aNormals[i * 9 + 2] = mesh.faceNormals[nmlIdx].z;
-
-    // uv for vertex 1
-    // int uvIdx = mesh.faces[i].vt1;
-    // aUvs[i * 6 + 0] = mesh.uvs[uvIdx].x;
-    // aUvs[i * 6 + 1] = mesh.uvs[uvIdx].y;
-
-    // vertex 2
-    vtxIdx = mesh.faces[i].v2;
-    aVtxCoords[i * 9 + 3] = mesh.vertices[vtxIdx].x;
-    aVtxCoords[i * 9 + 4] = mesh.vertices[vtxIdx].y;
-    aVtxCoords[i * 9 + 5] = mesh.vertices[vtxIdx].z;
-
-    // normal for vertex 2
-    nmlIdx = mesh.faces[i].vn2;
-    aNormals[i * 9 + 3] = mesh.faceNormals[nmlIdx].x;
-    aNormals[i * 9 + 4] = mesh.faceNormals[nmlIdx].y;
-    aNormals[i * 9 + 5] = mesh.faceNormals[nmlIdx].z;
-
-    // uv for vertex 2
-    // uvIdx = mesh.faces[i].vt2;
-    // aUvs[i * 6 + 2] = mesh.uvs[uvIdx].x;
-    // aUvs[i * 6 + 3] = mesh.uvs[uvIdx].y;
-
-    // vertex 3
-    vtxIdx = mesh.faces[i].v3;
-    aVtxCoords[i * 9 + 6] = mesh.vertices[vtxIdx].x;
-    aVtxCoords[i * 9 + 7] = mesh.vertices[vtxIdx].y;
-    aVtxCoords[i * 9 + 8] = mesh.vertices[vtxIdx].z;
-
-    // normal for vertex 3
-    nmlIdx = mesh.faces[i].vn3;
-    aNormals[i * 9 + 6] = mesh.faceNormals[nmlIdx].x;
-    aNormals[i * 9 + 7] = mesh.faceNormals[nmlIdx].y;
-    aNormals[i * 9 + 8] = mesh.faceNormals[nmlIdx].z;
-
-    // uv for vertex 3
-    // uvIdx = mesh.faces[i].vt3;
-    // aUvs[i * 6 + 4] = mesh.uvs[uvIdx].x;
-    // aUvs[i * 6 + 5] = mesh.uvs[uvIdx].y;
+    const Face &f = mesh.faces[i];
+    corners[i * 3 + 0] = (uint64_t(f.v1) << 32) | f.vn1;
+    corners[i * 3 + 1] = (uint64_t(f.v2) << 32) | f.vn2;
+    corners[i * 3 + 2] = (uint64_t(f.v3) << 32) | f.vn3;
+  }
+
+  // distinct pairs sorted by vertex are the GPU vertices
+  vector<uint64_t> pairs = corners;
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+  mesh.vtxStart.assign(nOfVtxs + 1, 0);
+  for (size_t g = 0; g < pairs.size(); g++) {
+    mesh.vtxStart[(pairs[g] >> 32) + 1]++;
+  }
+  for (size_t v = 0; v < nOfVtxs; v++) {
+    mesh.vtxStart[v + 1] += mesh.vtxStart[v];
   }
 
+  vector<GLfloat> aVtxCoords;
+  gatherPositions(mesh, 0, nOfVtxs, aVtxCoords);
+
+  vector<GLfloat> aNormals(pairs.size() * 3);
+  for (size_t g = 0; g < pairs.size(); g++) {
+    vec3 n = mesh.faceNormals[pairs[g] & 0xffffffffu];
+    aNormals[g * 3 + 0] = n.x;
+    aNormals[g * 3 + 1] = n.y;
+    aNormals[g * 3 + 2] = n.z;
+  }
+
+  vector<GLuint> aIdxs(corners.size());
+  for (size_t i = 0; i < corners.size(); i++) {
+    aIdxs[i] = GLuint(std::lower_bound(pairs.begin(), pairs.end(),
+                                       corners[i]) -
+                      pairs.begin());
+  }
+  mesh.nOfIndices = GLsizei(aIdxs.size());
+
   // vao
   glGenVertexArrays(1, &mesh.vao);
   glBindVertexArray(mesh.vao);
@@ -413,119 +415,54 @@ void createMesh(Mesh &mesh) {
   // vbo for vertex
   glGenBuffers(1, &mesh.vboVtxs);
   glBindBuffer(GL_ARRAY_BUFFER, mesh.vboVtxs);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nOfFaces * 3 * 3, aVtxCoords,
-               GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * aVtxCoords.size(),
+               aVtxCoords.data(), GL_STATIC_DRAW);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
   glEnableVertexAttribArray(0);
 
-  // vbo for texture
-  // glGenBuffers(1, &mesh.vboUvs);
-  // glBindBuffer(GL_ARRAY_BUFFER, mesh.vboUvs);
-  // glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nOfFaces * 3 * 2, aUvs,
-  //              GL_STATIC_DRAW);
-  // glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-  // glEnableVertexAttribArray(1);
-
   // vbo for normal
   glGenBuffers(1, &mesh.vboNormals);
   glBindBuffer(GL_ARRAY_BUFFER, mesh.vboNormals);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nOfFaces * 3 * 3, aNormals,
-               GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * aNormals.size(),
+               aNormals.data(), GL_STATIC_DRAW);
   glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
   glEnableVertexAttribArray(2);
 
-  // delete client data
-  delete[] aVtxCoords;
-  // delete[] aUvs;
-  delete[] aNormals;
+  // ebo, part of the vao state
+  glGenBuffers(1, &mesh.ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * aIdxs.size(),
+               aIdxs.data(), GL_STATIC_DRAW);
+
+  glBindVertexArray(0);
 }
 
-// Whenever the vertex attributes have been changed, call this function
+// Whenever the vertices have been changed on the CPU, call this function
 // Otherwise, the vertex data on the server side will not be updated
-void updateMesh(Mesh &mesh) {
-  // write vertex coordinate to array
-  int nOfFaces = mesh.faces.size();
-
-  // 3 vertices per face, 3 float per vertex coord, 2 float per tex coord
-  GLfloat *aVtxCoords = new GLfloat[nOfFaces * 3 * 3];
-  // GLfloat *aUvs = new GLfloat[nOfFaces * 3 * 2];
-  // GLfloat *aNormals = new GLfloat[nOfFaces * 3 * 3];
-
-  for (size_t i = 0; i < nOfFaces; i++) {
-    // vertex 1
-    int vtxIdx = mesh.faces[i].v1;
-    aVtxCoords[i * 9 + 0] = mesh.vertices[vtxIdx].x;
-    aVtxCoords[i * 9 + 1] = mesh.vertices[vtxIdx].y;
-    aVtxCoords[i * 9 + 2] = mesh.vertices[vtxIdx].z;
-
-    // normal for vertex 1
-    // int nmlIdx = mesh.faces[i].vn1;
-    // aNormals[i * 9 + 0] = mesh.faceNormals[nmlIdx].x;
-    // aNormals[i * 9 + 1] = mesh.faceNormals[nmlIdx].y;
-    // aNormals[i * 9 + 2] = mesh.faceNormals[nmlIdx].z;
-
-    // uv for vertex 1
-    // int uvIdx = mesh.faces[i].vt1;
-    // aUvs[i * 6 + 0] = mesh.uvs[uvIdx].x;
-    // aUvs[i * 6 + 1] = mesh.uvs[uvIdx].y;
-
-    // vertex 2
-    vtxIdx = mesh.faces[i].v2;
-    aVtxCoords[i * 9 + 3] = mesh.vertices[vtxIdx].x;
-    aVtxCoords[i * 9 + 4] = mesh.vertices[vtxIdx].y;
-    aVtxCoords[i * 9 + 5] = mesh.vertices[vtxIdx].z;
-
-    // normal for vertex 2
-    // nmlIdx = mesh.faces[i].vn2;
-    // aNormals[i * 9 + 3] = mesh.faceNormals[nmlIdx].x;
-    // aNormals[i * 9 + 4] = mesh.faceNormals[nmlIdx].y;
-    // aNormals[i * 9 + 5] = mesh.faceNormals[nmlIdx].z;
-
-    // uv for vertex 2
-    // uvIdx = mesh.faces[i].vt2;
-    // aUvs[i * 6 + 2] = mesh.uvs[uvIdx].x;
-    // aUvs[i * 6 + 3] = mesh.uvs[uvIdx].y;
-
-    // vertex 3
-    vtxIdx = mesh.faces[i].v3;
-    aVtxCoords[i * 9 + 6] = mesh.vertices[vtxIdx].x;
-    aVtxCoords[i * 9 + 7] = mesh.vertices[vtxIdx].y;
-    aVtxCoords[i * 9 + 8] = mesh.vertices[vtxIdx].z;
-
-    // normal for vertex 3
-    // nmlIdx = mesh.faces[i].vn3;
-    // aNormals[i * 9 + 6] = mesh.faceNormals[nmlIdx].x;
-    // aNormals[i * 9 + 7] = mesh.faceNormals[nmlIdx].y;
-    // aNormals[i * 9 + 8] = mesh.faceNormals[nmlIdx].z;
-
-    // uv for vertex 3
-    // uvIdx = mesh.faces[i].vt3;
-    // aUvs[i * 6 + 4] = mesh.uvs[uvIdx].x;
-    // aUvs[i * 6 + 5] = mesh.uvs[uvIdx].y;
+// For rigid moves of a drawn mesh, set mesh.model instead.
+void updateMesh(Mesh &mesh) { updateMesh(mesh, 0, mesh.vertices.size()); }
+
+// Upload only vertices[first, first + count), e.g. after a local
+// deformation. The indices and normals are left as they are.
+void updateMesh(Mesh &mesh, size_t first, size_t count) {
+  size_t last = std::min(first + count, mesh.vertices.size());
+  if (first >= last) {
+    return;
   }
 
-  // vao
-  glBindVertexArray(mesh.vao);
+  vector<GLfloat> aVtxCoords;
+  gatherPositions(mesh, first, last, aVtxCoords);
 
-  // vbo for vertex
   glBindBuffer(GL_ARRAY_BUFFER, mesh.vboVtxs);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nOfFaces * 3 * 3, aVtxCoords,
-               GL_STATIC_DRAW);
-
-  // vbo for texture
-  // glBindBuffer(GL_ARRAY_BUFFER, mesh.vboUvs);
-  // glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nOfFaces * 3 * 2, aUvs,
-  //              GL_STATIC_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER,
+                  sizeof(GLfloat) * 3 * mesh.vtxStart[first],
+                  sizeof(GLfloat) * aVtxCoords.size(), aVtxCoords.data());
+}
 
-  // vbo for normal
-  // glBindBuffer(GL_ARRAY_BUFFER, mesh.vboNormals);
-  // glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nOfFaces * 3 * 3, aNormals,
-  //              GL_STATIC_DRAW);
-
-  // delete client data
-  delete[] aVtxCoords;
-  // delete[] aUvs;
-  // delete[] aNormals;
+// The caller sets the M uniform, usually from mesh.model
+void drawMesh(Mesh &mesh) {
+  glBindVertexArray(mesh.vao);
+  glDrawElements(GL_TRIANGLES, mesh.nOfIndices, GL_UNSIGNED_INT, 0);
 }
 
 void drawPoints(std::vector<Point> &pts) { // array data
@@ -640,30 +577,124 @@ void drawTriangle(Triangle &tri) {
   glDeleteVertexArrays(1, &vao);
 }
 
-void drawPoints(Particles &ps) {
-  int nOfPs = ps.Ps.size();
+/* Particle upload */
+// positions are stored per axis, so interleave them here
+static void interleave(const FloatArray &x, const FloatArray &y,
+                       const FloatArray &z, GLfloat *dst) {
+  size_t n = x.size();
+  for (size_t i = 0; i < n; i++) {
+    dst[i * 3 + 0] = x[i];
+    dst[i * 3 + 1] = y[i];
+    dst[i * 3 + 2] = z[i];
+  }
+}
+
+static bool supportsPersistent() {
+  return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+// wait until the GPU is done with a region
+static void waitRegion(Particles &ps, int r) {
+  if (!ps.fences[r]) {
+    return;
+  }
+
+  while (glClientWaitSync(ps.fences[r], GL_SYNC_FLUSH_COMMANDS_BIT,
+                          1000000000) == GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(ps.fences[r]);
+  ps.fences[r] = 0;
+}
+
+// replace vboPos with a new buffer
+// three regions of persistently mapped storage, or plain mutable storage
+static void recreatePosBuffer(Particles &ps, size_t capacity,
+                              bool persistent) {
+  for (int r = 0; r < 3; r++) {
+    waitRegion(ps, r);
+  }
+
+  glBindVertexArray(ps.vao);
+  glDeleteBuffers(1, &ps.vboPos);
+  glGenBuffers(1, &ps.vboPos);
+  glBindBuffer(GL_ARRAY_BUFFER, ps.vboPos);
+
+  ps.mapped = nullptr;
+  ps.capacity = capacity;
+  ps.region = 0;
+
+  if (persistent) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = 3 * capacity * 3 * sizeof(GLfloat);
+    glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    ps.mapped = (GLfloat *)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+  }
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  glEnableVertexAttribArray(0);
+}
+
+// Draw the positions x, y, z with the buffers of ps.
+// With persistent mapping (GL 4.4 or ARB_buffer_storage), positions are
+// written straight into one of three regions of a mapped buffer, and a
+// fence makes sure the GPU has finished drawing from that region three
+// frames ago. Otherwise, they are interleaved into staging and uploaded
+// with a single glBufferData, which orphans the old storage.
+// Either way there is one upload per frame, not one per particle.
+void drawPoints(Particles &ps, const FloatArray &x, const FloatArray &y,
+                const FloatArray &z) {
+  size_t nOfPs = x.size();
+  bool persistent = ps.persistent && supportsPersistent();
 
   // select vao
   glBindVertexArray(ps.vao);
 
   // position
-  glBindBuffer(GL_ARRAY_BUFFER, ps.vboPos);
-  // buffer orphaning
-  glBufferData(GL_ARRAY_BUFFER, nOfPs * 3 * sizeof(GLfloat), NULL,
-               GL_STREAM_DRAW);
-  for (size_t i = 0; i < nOfPs; i++) {
-    Point &p = ps.Ps[i];
+  if (persistent && (!ps.mapped || nOfPs > ps.capacity)) {
+    // never empty, storage of size 0 cannot be created or mapped
+    recreatePosBuffer(ps, std::max({nOfPs, ps.capacity * 3 / 2, size_t(1)}),
+                      true);
+
+    if (!ps.mapped) {
+      std::cout << "failed to map the position buffer, using glBufferData"
+                << std::endl;
+      ps.persistent = false;
+      persistent = false;
+      recreatePosBuffer(ps, 0, false); // the storage above is immutable
+    }
+  }
+
+  if (persistent) {
+    int r = ps.region;
+    waitRegion(ps, r);
 
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3 * i,
-                    sizeof(GLfloat) * 3, &p.pos);
+    size_t offset = r * ps.capacity * 3;
+    interleave(x, y, z, ps.mapped + offset);
 
-    // if vec3 does not save data continuously in memory
-    // use the following code
-    // GLfloat temp[] = {p.pos.x, p.pos.y, p.pos.z};
-    // glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3 * i,
-    //                 sizeof(GLfloat) * 3, &temp);
+    glBindBuffer(GL_ARRAY_BUFFER, ps.vboPos);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
+                          (GLvoid *)(offset * sizeof(GLfloat)));
+
+    glDrawArrays(GL_POINTS, 0, nOfPs);
+
+    ps.fences[r] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ps.region = (r + 1) % 3;
+    return;
+  }
+
+  // the persistent path was switched off
+  if (ps.mapped) {
+    recreatePosBuffer(ps, 0, false);
   }
 
+  ps.staging.resize(nOfPs * 3);
+  interleave(x, y, z, ps.staging.data());
+
+  glBindBuffer(GL_ARRAY_BUFFER, ps.vboPos);
+  glBufferData(GL_ARRAY_BUFFER, nOfPs * 3 * sizeof(GLfloat),
+               ps.staging.data(), GL_STREAM_DRAW);
+
   // color
   // glBindBuffer(GL_ARRAY_BUFFER, ps.vboColor);
   // // buffer orphaning
@@ -1,5 +1,13 @@
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <sstream>
 #include "common.h"
 #include "sdf.h"
+#include "meshBvh.h"
+#include "sparseGrid.h"
+#include "sdfUpdate.h"
+#include "sdfCache.h"
 
 GLFWwindow *window;
 
@@ -7,80 +15,932 @@ ivec3 nOfCells;
 float cellSize = 0.1f;
 vec3 gridOrigin(0, 0, 0);
 vec3 rangeOffset(0.2f, 0.2f, 0.2f);
+vec3 meshOffset; // translation of the mesh into the grid, see initMesh
+string meshFile = "./mesh/bunny.obj";
 Grid grid;
 Mesh mesh;
 
+// fields generated before, see calCacheKey
+SdfCache cache;
+const uint32_t generatorVersion = 2; // bump whenever the values change
+
+// generation mode, see main
+bool hierarchical = false;
+bool sparse = false;
+string editedFile = ""; // edit mode
+string sequencePattern = ""; // sequence mode, printf pattern of frame files
+int nOfFrames = 0;
+bool streaming = false;
+int slabDepth = 16; // z-layers per slab in stream mode
+bool sharding = false;
+int shardIndex = 0, nOfShards = 1; // shard mode, by index
+ivec3 shardLo(-1), shardHi(-1);    // shard mode, by box
+float band = 0.3f;       // cells closer than this are exact
+float tolerance = 0.01f; // interpolation error allowed at block centers
+int nOfEvaluations = 0;
+
 void initGL();
 void initOther();
 void initGrid();
 void initMesh();
+float calDistance(vec3, int &);
+void createSdfFull();
+void createSdfHierarchical();
+void measureError(int);
+void createSdfSparse();
+void updateEdited();
+void createSdfSequence();
+void createSdfStream();
+void createShard();
+uint64_t calCacheKey();
 
-void writeSdf(Grid &, const string);
 vec3 calCellPos(vec3);
 float randf();
 
 int main(int argc, char const *argv[]) {
+  // createSdf               : every cell against every triangle
+  // createSdf hierarchical [band] [tolerance]
+  //                         : coarse-to-fine, exact within band
+  // createSdf sparse [cellSize] [band]
+  //                         : bricks within band only, to sdf.sparse
+  // createSdf edit [editedMesh]
+  //                         : update sdf.txt of bunny.obj to an edited
+  //                           copy, recomputing only affected cells
+  // createSdf sequence [framePattern] [nOfFrames] [cellSize]
+  //                         : every frame of an animation, each from the
+  //                           previous one, to ./result/sdf%04d.txt
+  // createSdf stream [cellSize] [slabDepth]
+  //                         : one slab of z-layers at a time, straight to
+  //                           sdf.txt, resumes an interrupted run
+  // createSdf shard [index] [count] [cellSize]
+  // createSdf shard box [i0] [j0] [k0] [i1] [j1] [k1] [cellSize]
+  //                         : one part of the grid to a shard file,
+  //                           see mergeSdf
+  string mode = (argc > 1) ? argv[1] : "";
+  hierarchical = (mode == "hierarchical");
+  sparse = (mode == "sparse");
+  streaming = (mode == "stream");
+  sharding = (mode == "shard");
+
+  if (hierarchical) {
+    if (argc > 2) {
+      band = float(atof(argv[2]));
+    }
+    if (argc > 3) {
+      tolerance = float(atof(argv[3]));
+    }
+  }
+
+  if (sparse) {
+    if (argc > 2) {
+      cellSize = float(atof(argv[2]));
+    }
+    if (argc > 3) {
+      band = float(atof(argv[3]));
+    }
+  }
+
+  if (streaming) {
+    if (argc > 2) {
+      cellSize = float(atof(argv[2]));
+    }
+    if (argc > 3) {
+      slabDepth = std::max(atoi(argv[3]), 1);
+    }
+  }
+
+  if (sharding) {
+    if (argc > 2 && string(argv[2]) == "box") {
+      if (argc < 9) {
+        std::cout << "usage: createSdf shard box i0 j0 k0 i1 j1 k1" << '\n';
+        return 1;
+      }
+      shardLo = ivec3(atoi(argv[3]), atoi(argv[4]), atoi(argv[5]));
+      shardHi = ivec3(atoi(argv[6]), atoi(argv[7]), atoi(argv[8]));
+      if (argc > 9) {
+        cellSize = float(atof(argv[9]));
+      }
+    } else {
+      shardIndex = (argc > 2) ? atoi(argv[2]) : 0;
+      nOfShards = (argc > 3) ? std::max(atoi(argv[3]), 1) : 1;
+      if (argc > 4) {
+        cellSize = float(atof(argv[4]));
+      }
+    }
+  }
+
+  if (mode == "edit") {
+    editedFile = (argc > 2) ? argv[2] : "./mesh/bunnyEdited.obj";
+  }
+
+  if (mode == "sequence") {
+    sequencePattern = (argc > 2) ? argv[2] : "./mesh/anim/frame%04d.obj";
+    nOfFrames = (argc > 3) ? atoi(argv[3]) : 1;
+    if (argc > 4) {
+      cellSize = float(atof(argv[4]));
+    }
+
+    // the grid is laid out around the first frame
+    char name[512];
+    snprintf(name, sizeof(name), sequencePattern.c_str(), 0);
+    meshFile = name;
+  }
+
   initGL();
   initOther();
   initMesh();
+
+  // the dense grid is never built, it may not fit in memory
+  if (sparse) {
+    createSdfSparse();
+    return 0;
+  }
+
+  if (streaming) {
+    createSdfStream();
+    return 0;
+  }
+
+  if (sharding) {
+    createShard();
+    return 0;
+  }
+
   initGrid();
 
-  /* find a searching range */
-  // select an area a little bigger than mesh's aabb
-  vec3 rangeMin = mesh.min - rangeOffset;
-  vec3 rangeMax = mesh.max + rangeOffset;
-
-  // find cells which cover those area
-  vec3 startCell = calCellPos(rangeMin);
-  vec3 endCell = calCellPos(rangeMax);
-
-  // for the selected range
-  for (float z = startCell.z; z < endCell.z; z += cellSize) {
-    for (float y = startCell.y; y < endCell.y; y += cellSize) {
-      for (float x = startCell.x; x < endCell.x; x += cellSize) {
-        vec3 P(x, y, z); // cell position
-        float dist = 9999.f;
-
-        // iterate triangles in the mesh
-        for (size_t i = 0; i < mesh.faces.size(); i++) {
-          Face face = mesh.faces[i];
-
-          glm::vec3 A, B, C, N;
-          A = mesh.vertices[face.v1];
-          B = mesh.vertices[face.v2];
-          C = mesh.vertices[face.v3];
-          N = mesh.faceNormals[face.vn1];
-
-          float temp = distPoint2Triangle(A, B, C, N, P);
-          float oldDist = dist;
-
-          // for general case
-          dist = (glm::abs(temp) < glm::abs(dist)) ? temp : dist;
-
-          // for a special case
-          float delta = abs(abs(temp) - abs(oldDist));
-          // if delta is less than some threshold
-          // we decide that temp is equal to dist
-          if (delta < 0.0001f) {
-
-            // if dist will change its sign
-            // we keep dist at the positive one
-            dist = (temp > 0) ? temp : oldDist;
-          }
-        } // end iterate triangles
-
-        // write dist into grid
-        int hash = calCellHash(P, nOfCells, cellSize);
-        grid.cells[hash].sd = dist;
-      } // end x direction
-    }   // end y direction
-  }     // end z direction
+  if (editedFile != "") {
+    updateEdited();
+    return 0;
+  }
+
+  if (sequencePattern != "") {
+    createSdfSequence();
+    return 0;
+  }
+
+  // the same mesh with the same parameters has been generated before
+  uint64_t key = calCacheKey();
+  if (cache.load(key, grid)) {
+    std::cout << "loaded from " << cache.calPath(key) << '\n';
+    writeSdf(grid, "sdf.txt");
+    return 0;
+  }
 
+  double start = glfwGetTime();
+
+  if (hierarchical) {
+    createSdfHierarchical();
+  } else {
+    createSdfFull();
+  }
+
+  std::cout << nOfEvaluations << " of " << grid.cells.size()
+            << " cells tested against the mesh in "
+            << glfwGetTime() - start << " s" << '\n';
+
+  if (hierarchical) {
+    measureError(1000);
+  }
+
+  cache.store(key, grid);
   writeSdf(grid, "sdf.txt");
 
   return 0;
 }
 
+// Signed distance from P to the mesh, testing every triangle
+// faceId receives the face the distance comes from
+float calDistance(vec3 P, int &faceId) {
+  float dist = 9999.f;
+  faceId = -1;
+
+  // iterate triangles in the mesh
+  for (size_t i = 0; i < mesh.faces.size(); i++) {
+    Face face = mesh.faces[i];
+
+    glm::vec3 A, B, C, N;
+    A = mesh.vertices[face.v1];
+    B = mesh.vertices[face.v2];
+    C = mesh.vertices[face.v3];
+    N = mesh.faceNormals[face.vn1];
+
+    float temp = distPoint2Triangle(A, B, C, N, P);
+    float oldDist = dist;
+
+    // for general case
+    dist = (glm::abs(temp) < glm::abs(dist)) ? temp : dist;
+
+    // for a special case
+    float delta = abs(abs(temp) - abs(oldDist));
+    // if delta is less than some threshold
+    // we decide that temp is equal to dist
+    if (delta < 0.0001f) {
+
+      // if dist will change its sign
+      // we keep dist at the positive one
+      dist = (temp > 0) ? temp : oldDist;
+    }
+
+    if (dist != oldDist) {
+      faceId = int(i);
+    }
+  } // end iterate triangles
+
+  nOfEvaluations++;
+
+  return dist;
+}
+
+// The grid covers the mesh's aabb plus rangeOffset, so every cell is
+// computed. Cells are visited by index: stepping positions by cellSize
+// accumulates rounding errors, and some cells were hashed into their
+// neighbors.
+void createSdfFull() {
+  for (size_t h = 0; h < grid.cells.size(); h++) {
+    int faceId;
+    grid.cells[h].sd = calDistance(grid.cells[h].pos, faceId);
+    grid.faceIds[h] = faceId;
+  }
+}
+
+/* Coarse-to-fine generation */
+// A signed distance field is 1-Lipschitz: |d(x) - d(y)| <= |x - y|.
+// The grid is covered by blocks of blockSize^3 cells. The distance is
+// computed exactly at the 8 corners of a block. If every corner is
+// further from the surface than band + the block diagonal, every cell
+// in the block is further than band, and no surface passes through the
+// block; its cells are filled by trilinear interpolation of the corners.
+// Otherwise the block is split into 8 and the test is repeated, down to
+// single cells, which are computed exactly.
+// Cells with |d| <= band are therefore always exact.
+// Far from the surface the field is smooth except near the medial axis,
+// where interpolation is poor. The center of a block is computed exactly
+// as well, and the block is split if it misses the interpolated value by
+// more than tolerance.
+// The corners are cells of a lattice padded to a multiple of blockSize,
+// exact values are kept there so neighboring blocks share their corners.
+int blockSize = 16; // power of two
+ivec3 nOfLattice;    // lattice points per axis
+vector<float> latticeSd;
+vector<int> latticeFace;
+vector<char> isExact;
+
+static int latticeIdx(ivec3 idx) {
+  return idx.x + nOfLattice.x * (idx.y + nOfLattice.y * idx.z);
+}
+
+static float exactAt(ivec3 idx) {
+  int l = latticeIdx(idx);
+  if (!isExact[l]) {
+    vec3 P = vec3(idx) * cellSize + gridOrigin;
+    latticeSd[l] = calDistance(P, latticeFace[l]);
+    isExact[l] = 1;
+  }
+
+  return latticeSd[l];
+}
+
+static void refineBlock(ivec3 lo, int size) {
+  // skip blocks that lie entirely in the padding
+  if (lo.x >= nOfCells.x || lo.y >= nOfCells.y || lo.z >= nOfCells.z) {
+    return;
+  }
+
+  float corners[8];
+  float nearest = 9999.f;
+  for (int c = 0; c < 8; c++) {
+    ivec3 offset = ivec3(c & 1, (c >> 1) & 1, (c >> 2) & 1) * size;
+    corners[c] = exactAt(lo + offset);
+    nearest = std::min(nearest, abs(corners[c]));
+  }
+
+  if (size == 1) {
+    return;
+  }
+
+  // trilinear interpolation of the corners at t in [0, 1]^3
+  auto interpolate = [&](vec3 t) {
+    float x0 = mix(corners[0], corners[1], t.x);
+    float x1 = mix(corners[2], corners[3], t.x);
+    float x2 = mix(corners[4], corners[5], t.x);
+    float x3 = mix(corners[6], corners[7], t.x);
+    return mix(mix(x0, x1, t.y), mix(x2, x3, t.y), t.z);
+  };
+
+  float diagonal = size * cellSize * sqrt(3.f);
+  bool canFill = (nearest > band + diagonal);
+
+  // only worth checking once the block is known to be far
+  if (canFill) {
+    float center = exactAt(lo + ivec3(size / 2));
+    canFill = (abs(center - interpolate(vec3(0.5f))) <= tolerance);
+  }
+
+  if (!canFill) {
+    int half = size / 2;
+    for (int c = 0; c < 8; c++) {
+      refineBlock(lo + ivec3(c & 1, (c >> 1) & 1, (c >> 2) & 1) * half, half);
+    }
+    return;
+  }
+
+  // far from the surface, interpolate
+  // the closest face is not known, so the face stays -1
+  for (int k = 0; k <= size; k++) {
+    for (int j = 0; j <= size; j++) {
+      for (int i = 0; i <= size; i++) {
+        ivec3 idx = lo + ivec3(i, j, k);
+        int l = latticeIdx(idx);
+        if (isExact[l]) {
+          continue;
+        }
+
+        vec3 t = vec3(i, j, k) / float(size);
+        latticeSd[l] = interpolate(t);
+      }
+    }
+  }
+}
+
+void createSdfHierarchical() {
+  ivec3 nOfBlocks = (nOfCells + ivec3(blockSize - 1)) / blockSize;
+  nOfLattice = nOfBlocks * blockSize + ivec3(1);
+
+  size_t n = size_t(nOfLattice.x) * nOfLattice.y * nOfLattice.z;
+  latticeSd.assign(n, 9999.f);
+  latticeFace.assign(n, -1);
+  isExact.assign(n, 0);
+
+  for (int k = 0; k < nOfBlocks.z; k++) {
+    for (int j = 0; j < nOfBlocks.y; j++) {
+      for (int i = 0; i < nOfBlocks.x; i++) {
+        refineBlock(ivec3(i, j, k) * blockSize, blockSize);
+      }
+    }
+  }
+
+  // copy the cells of the grid out of the lattice
+  for (size_t h = 0; h < grid.cells.size(); h++) {
+    int l = latticeIdx(grid.cells[h].idx);
+    grid.cells[h].sd = latticeSd[l];
+    grid.faceIds[h] = latticeFace[l];
+  }
+}
+
+// compare random interpolated cells with their exact distance
+void measureError(int nOfSamples) {
+  vector<size_t> filled;
+  for (size_t h = 0; h < grid.cells.size(); h++) {
+    if (!isExact[latticeIdx(grid.cells[h].idx)]) {
+      filled.push_back(h);
+    }
+  }
+
+  if (filled.empty()) {
+    return;
+  }
+
+  double maxError = 0.0, sumError = 0.0;
+  int evaluations = nOfEvaluations;
+  for (int s = 0; s < nOfSamples; s++) {
+    const Cell &cell = grid.cells[filled[rand() % filled.size()]];
+
+    int faceId;
+    float error = abs(calDistance(cell.pos, faceId) - cell.sd);
+    maxError = std::max(maxError, double(error));
+    sumError += error;
+  }
+  nOfEvaluations = evaluations;
+
+  std::cout << "interpolated cells (|d| > " << band << "): " << filled.size()
+            << ", error over " << nOfSamples << " samples: mean "
+            << sumError / nOfSamples << ", max " << maxError << '\n';
+}
+
+/* Sparse generation */
+// Only bricks near the surface are computed, see SparseGrid.
+// Regions of bricks are tested coarse to fine, as blocks are in
+// createSdfHierarchical: if the distance at the center of a region
+// exceeds band plus the distance to its farthest cell, no cell of the
+// region is within band, and its bricks are left unallocated with a
+// coarse value derived from the center. Otherwise the region is split
+// into 8, down to single bricks, which are allocated.
+// Distances come from a MeshBvh instead of the loop over all triangles,
+// so a cell costs a few triangle tests, and cells are computed in
+// parallel. Cells of allocated bricks are exact.
+int regionSize = 16; // bricks per axis of the top regions, power of two
+SparseGrid sparseGrid;
+MeshBvh meshBvh;
+
+// largest distance from p to a cell of the box [lo, hi]
+static float farthestCell(vec3 p, ivec3 lo, ivec3 hi) {
+  vec3 a = abs(vec3(lo) * cellSize + gridOrigin - p);
+  vec3 b = abs(vec3(hi) * cellSize + gridOrigin - p);
+  return length(max(a, b));
+}
+
+// bricks [lo, lo + size), returns the number of distances computed
+static int refineRegion(ivec3 lo, int size) {
+  ivec3 nOfBricks = sparseGrid.nOfBricks;
+  if (lo.x >= nOfBricks.x || lo.y >= nOfBricks.y || lo.z >= nOfBricks.z) {
+    return 0;
+  }
+
+  const int b = SparseGrid::brickSize;
+  ivec3 hi = min(lo + ivec3(size), nOfBricks); // exclusive
+  ivec3 cellLo = lo * b;
+  ivec3 cellHi = min(hi * b, nOfCells) - ivec3(1);
+
+  vec3 center = (vec3(cellLo + cellHi) * 0.5f) * cellSize + gridOrigin;
+  float d = meshBvh.query(center).distance;
+  float side = (d < 0.f) ? -1.f : 1.f;
+
+  if (abs(d) - farthestCell(center, cellLo, cellHi) > band) {
+    for (int k = lo.z; k < hi.z; k++) {
+      for (int j = lo.y; j < hi.y; j++) {
+        for (int i = lo.x; i < hi.x; i++) {
+          ivec3 bLo = ivec3(i, j, k) * b;
+          ivec3 bHi = min(bLo + ivec3(b), nOfCells) - ivec3(1);
+          float bound = abs(d) - farthestCell(center, bLo, bHi);
+          sparseGrid.coarse[sparseGrid.calBrickHash(ivec3(i, j, k))] =
+              side * bound;
+        }
+      }
+    }
+    return 1;
+  }
+
+  if (size == 1) {
+    // to be allocated
+    int hash = sparseGrid.calBrickHash(lo);
+    sparseGrid.index[hash] = -2;
+    sparseGrid.coarse[hash] = d;
+    return 1;
+  }
+
+  int count = 1;
+  int half = size / 2;
+  for (int c = 0; c < 8; c++) {
+    count += refineRegion(lo + ivec3(c & 1, (c >> 1) & 1, (c >> 2) & 1) * half,
+                          half);
+  }
+
+  return count;
+}
+
+// exact distances of every cell of an allocated brick
+static int fillBrick(int hash, int n) {
+  const int b = SparseGrid::brickSize;
+  ivec3 nOfBricks = sparseGrid.nOfBricks;
+  ivec3 brick(hash % nOfBricks.x, (hash / nOfBricks.x) % nOfBricks.y,
+              hash / (nOfBricks.x * nOfBricks.y));
+
+  float *data = sparseGrid.getBrick(n);
+  float nearest = 9999.f;
+  int hint = -1; // the neighboring cell's face is usually the closest
+  int count = 0;
+
+  for (int k = 0; k < b; k++) {
+    for (int j = 0; j < b; j++) {
+      for (int i = 0; i < b; i++) {
+        ivec3 idx = brick * b + ivec3(i, j, k);
+        if (any(greaterThanEqual(idx, nOfCells))) {
+          continue;
+        }
+
+        MeshQuery q = meshBvh.query(vec3(idx) * cellSize + gridOrigin,
+                                    9999.f, hint);
+        data[i + b * (j + b * k)] = q.distance;
+        hint = q.face;
+        count++;
+
+        if (abs(q.distance) < abs(nearest)) {
+          nearest = q.distance;
+        }
+      }
+    }
+  }
+
+  // the nearest cell, for gradients taken from a neighboring brick
+  sparseGrid.coarse[hash] = nearest;
+
+  return count;
+}
+
+void createSdfSparse() {
+  // the same box as initGrid
+  vec3 gridSize = (mesh.max + rangeOffset) - gridOrigin;
+  nOfCells = ivec3(gridSize / cellSize);
+
+  double start = glfwGetTime();
+  meshBvh.build(mesh);
+  sparseGrid.init(gridOrigin, cellSize, nOfCells, band);
+
+  // regions only write the entries of their own bricks
+  ivec3 nOfRegions = (sparseGrid.nOfBricks + ivec3(regionSize - 1)) /
+                     regionSize;
+  int n = nOfRegions.x * nOfRegions.y * nOfRegions.z;
+  vector<int> counts(n, 0);
+
+  parallelFor(n, [&](int begin, int end) {
+    for (int r = begin; r < end; r++) {
+      ivec3 region(r % nOfRegions.x, (r / nOfRegions.x) % nOfRegions.y,
+                   r / (nOfRegions.x * nOfRegions.y));
+      counts[r] = refineRegion(region * regionSize, regionSize);
+    }
+  });
+
+  // allocation moves the bricks, so it is done before filling them
+  vector<int> allocated;
+  for (size_t h = 0; h < sparseGrid.index.size(); h++) {
+    if (sparseGrid.index[h] == -2) {
+      sparseGrid.index[h] = -1;
+      sparseGrid.allocate(int(h));
+      allocated.push_back(int(h));
+    }
+  }
+
+  counts.resize(n + allocated.size(), 0);
+  parallelFor(int(allocated.size()), [&](int begin, int end) {
+    for (int a = begin; a < end; a++) {
+      int hash = allocated[a];
+      counts[n + a] = fillBrick(hash, sparseGrid.index[hash]);
+    }
+  });
+
+  for (size_t c = 0; c < counts.size(); c++) {
+    nOfEvaluations += counts[c];
+  }
+
+  size_t nOfDense = size_t(nOfCells.x) * nOfCells.y * nOfCells.z;
+  std::cout << nOfCells.x << " x " << nOfCells.y << " x " << nOfCells.z
+            << " cells, " << nOfEvaluations << " distances computed in "
+            << glfwGetTime() - start << " s" << '\n';
+  std::cout << sparseGrid.nOfAllocated() << " of " << sparseGrid.index.size()
+            << " bricks allocated, " << sparseGrid.memory() / 1048576.0
+            << " MB (dense " << nOfDense * sizeof(float) / 1048576.0 << " MB)"
+            << '\n';
+
+  writeSparseSdf(sparseGrid, "sdf.sparse");
+}
+
+/* Incremental update */
+// sdf.txt must hold the field of bunny.obj with its face column, e.g. from
+// a previous run. The edited mesh is placed with the same offset, so only
+// the moved vertices differ. The result replaces sdf.txt, the next edit
+// starts from it.
+void updateEdited() {
+  Grid previous;
+  readSdf(previous, "sdf.txt");
+  if (previous.cells.size() != grid.cells.size()) {
+    std::cout << "sdf.txt does not match the grid, run createSdf first"
+              << '\n';
+    return;
+  }
+
+  for (size_t h = 0; h < grid.cells.size(); h++) {
+    grid.cells[h].sd = previous.cells[h].sd;
+  }
+  grid.faceIds = previous.faceIds; // empty if sdf.txt has no face column
+
+  Mesh edited = loadObj(editedFile);
+  edited.translate(meshOffset);
+  if (edited.faces.size() != mesh.faces.size() ||
+      edited.vertices.size() != mesh.vertices.size()) {
+    std::cout << editedFile << " is not an edit of the mesh" << '\n';
+    return;
+  }
+
+  double start = glfwGetTime();
+
+  vector<int> faces = findChangedFaces(mesh, edited);
+
+  MeshBvh bvh;
+  bvh.build(edited);
+  double built = glfwGetTime();
+
+  SdfUpdate update = updateSdf(grid, mesh, edited, bvh, faces);
+
+  std::cout << faces.size() << " faces changed, " << update.nOfVisited
+            << " cells visited, " << update.nOfRecomputed << " recomputed, "
+            << update.nOfChanged << " changed of " << grid.cells.size()
+            << '\n';
+  std::cout << "bvh " << built - start << " s, update "
+            << glfwGetTime() - built << " s" << '\n';
+
+  writeSdf(grid, "sdf.txt");
+}
+
+/* Sequence generation */
+// The frames of a deforming mesh share their faces, only vertices move.
+// The first frame builds a MeshBvh and searches every cell from scratch.
+// Later frames refit the tree instead of building it, and start the
+// search of every cell at the face that was closest in the previous
+// frame. With slow motion that face is still close, and its distance is
+// an upper bound that prunes almost the whole tree.
+// A frame is written on a background thread from its own copy of the
+// grid while the next one is computed; at most maxPending frames wait
+// for the disk.
+int maxPending = 2;
+
+void createSdfSequence() {
+  MeshBvh bvh;
+  std::deque<std::future<void>> pending;
+  double first = 0.0, rest = 0.0;
+  int nOfLater = 0;
+
+  for (int f = 0; f < nOfFrames; f++) {
+    if (f > 0) {
+      char name[512];
+      snprintf(name, sizeof(name), sequencePattern.c_str(), f);
+
+      Mesh frame = loadObj(name);
+      if (frame.faces.size() != mesh.faces.size() ||
+          frame.vertices.size() != mesh.vertices.size()) {
+        std::cout << name << " does not match the first frame" << '\n';
+        break;
+      }
+      frame.translate(meshOffset);
+      mesh.vertices = frame.vertices;
+      mesh.faceNormals = frame.faceNormals;
+    }
+
+    double start = glfwGetTime();
+
+    if (f == 0) {
+      bvh.build(mesh);
+    } else {
+      bvh.refit(mesh);
+    }
+
+    bool warm = (f > 0);
+    parallelFor(int(grid.cells.size()), [&](int begin, int end) {
+      for (int h = begin; h < end; h++) {
+        int hint = warm ? grid.faceIds[h] : -1;
+        MeshQuery q = bvh.query(grid.cells[h].pos, 9999.f, hint);
+        grid.cells[h].sd = q.distance;
+        grid.faceIds[h] = q.face;
+      }
+    });
+
+    double time = glfwGetTime() - start;
+    if (f == 0) {
+      first = time;
+    } else {
+      rest += time;
+      nOfLater++;
+    }
+    std::cout << "frame " << f << ": " << time << " s" << '\n';
+
+    // zero padding, e.g. "./result/sdf0012.txt"
+    string num = to_string(f);
+    num = string(std::max(4 - int(num.length()), 0), '0') + num;
+    string fileName = "./result/sdf" + num + ".txt";
+
+    if (int(pending.size()) >= maxPending) {
+      pending.front().get();
+      pending.pop_front();
+    }
+    pending.push_back(std::async(std::launch::async,
+                                 [copy = grid, fileName]() mutable {
+                                   writeSdf(copy, fileName);
+                                 }));
+  }
+
+  while (!pending.empty()) {
+    pending.front().get();
+    pending.pop_front();
+  }
+
+  if (nOfLater > 0) {
+    std::cout << "first frame " << first << " s, later frames "
+              << rest / nOfLater << " s on average" << '\n';
+  }
+}
+
+/* Streaming generation */
+// For grids larger than memory. The cells are computed one slab of
+// slabDepth z-layers at a time with a MeshBvh, and the slab is appended to
+// sdf.txt in the format of writeSdf as soon as it is done, so only one
+// slab is ever in memory.
+// After every slab, the number of finished slabs and the size of the
+// output are saved to the checkpoint file. A run with the same
+// parameters and mesh file that finds a checkpoint cuts the output back
+// to that size, dropping a partly written slab, and continues with the
+// next slab.
+string streamFile = "sdf.txt";
+string checkpointFile = "sdf.txt.checkpoint";
+
+// parameters, hash of the mesh file, finished slabs and output size
+static void writeCheckpoint(uint64_t meshHash, int nOfDone,
+                            uintmax_t size) {
+  // written aside and renamed, so a crash never leaves half a checkpoint
+  string temp = checkpointFile + ".tmp";
+  ofstream output(temp);
+  output << nOfCells.x << " " << nOfCells.y << " " << nOfCells.z << " "
+         << cellSize << " " << slabDepth << " " << meshHash << " "
+         << nOfDone << " " << size << '\n';
+  output.close();
+
+  std::rename(temp.c_str(), checkpointFile.c_str());
+}
+
+// false if there is none, or it belongs to another grid or mesh
+static bool readCheckpoint(uint64_t meshHash, int &nOfDone,
+                           uintmax_t &size) {
+  ifstream fin(checkpointFile);
+  if (!(fin.good())) {
+    return false;
+  }
+
+  ivec3 n;
+  float size0;
+  int depth;
+  uint64_t hash;
+  fin >> n.x >> n.y >> n.z >> size0 >> depth >> hash >> nOfDone >> size;
+
+  if (fin && hash != meshHash) {
+    std::cout << "checkpoint of another mesh, starting over" << '\n';
+    return false;
+  }
+
+  // cellSize went through text, compare the grids it gives instead
+  return bool(fin) && n == nOfCells && depth == slabDepth &&
+         abs(size0 - cellSize) <= 1e-6f * cellSize;
+}
+
+void createSdfStream() {
+  // the same box as initGrid
+  vec3 gridSize = (mesh.max + rangeOffset) - gridOrigin;
+  nOfCells = ivec3(gridSize / cellSize);
+  int nOfSlabs = (nOfCells.z + slabDepth - 1) / slabDepth;
+
+  MeshBvh bvh;
+  bvh.build(mesh);
+
+  // the mesh may have been edited since the checkpoint was written
+  uint64_t meshHash = hashFile(meshFile);
+
+  int first = 0;
+  uintmax_t size = 0;
+  std::error_code error;
+  if (readCheckpoint(meshHash, first, size) &&
+      std::filesystem::file_size(streamFile, error) >= size && !error) {
+    std::filesystem::resize_file(streamFile, size);
+    std::cout << "resuming at slab " << first << " of " << nOfSlabs << '\n';
+  } else {
+    first = 0;
+    ofstream(streamFile, std::ios::trunc).close();
+  }
+
+  ofstream output(streamFile, std::ios::app);
+  if (!(output.good())) {
+    cout << "failed to open file : " << streamFile << std::endl;
+    return;
+  }
+
+  double start = glfwGetTime();
+
+  // one line of text per cell, formatted in parallel row by row
+  vector<string> rows;
+
+  for (int s = first; s < nOfSlabs; s++) {
+    int k0 = s * slabDepth;
+    int nOfLayers = std::min(slabDepth, nOfCells.z - k0);
+    rows.assign(size_t(nOfLayers) * nOfCells.y, string());
+
+    parallelFor(int(rows.size()), [&](int begin, int end) {
+      std::ostringstream line;
+
+      for (int r = begin; r < end; r++) {
+        int j = r % nOfCells.y;
+        int k = k0 + r / nOfCells.y;
+        int hint = -1; // the previous cell's face
+        line.str("");
+
+        for (int i = 0; i < nOfCells.x; i++) {
+          vec3 pos = vec3(i, j, k) * cellSize + gridOrigin;
+          MeshQuery q = bvh.query(pos, 9999.f, hint);
+          hint = q.face;
+
+          line << pos.x << " " << pos.y << " " << pos.z << " " << i << " "
+               << j << " " << k << " " << q.distance << " " << q.face
+               << '\n';
+        }
+
+        rows[r] = line.str();
+      }
+    });
+
+    for (size_t r = 0; r < rows.size(); r++) {
+      output << rows[r];
+    }
+    output.flush();
+
+    writeCheckpoint(meshHash, s + 1, std::filesystem::file_size(streamFile));
+    std::cout << "slab " << s + 1 << " of " << nOfSlabs << " after "
+              << glfwGetTime() - start << " s" << '\n';
+  }
+
+  output.close();
+  std::remove(checkpointFile.c_str());
+
+  std::cout << nOfCells.x << " x " << nOfCells.y << " x " << nOfCells.z
+            << " cells written to " << streamFile << '\n';
+}
+
+// Everything the values of the full and hierarchical modes depend on
+uint64_t calCacheKey() {
+  uint64_t key = hashFile(meshFile);
+  key = hashValue(generatorVersion, key);
+  key = hashValue(hierarchical, key);
+  key = hashValue(cellSize, key);
+  key = hashValue(gridOrigin, key);
+  key = hashValue(rangeOffset, key);
+
+  if (hierarchical) {
+    key = hashValue(band, key);
+    key = hashValue(tolerance, key);
+  }
+
+  return key;
+}
+
+/* Sharded generation */
+// A shard is a box of cells of the grid, computed by its own process.
+// Shards by index split the z-layers into count contiguous parts, and any
+// process computes the same part from the same arguments, so shards can
+// run anywhere without talking to each other. mergeSdf assembles them.
+// Each cell is searched without a hint: a hint may decide between two
+// faces at the same distance, and the result of a cell must not depend
+// on where its shard starts.
+void createShard() {
+  // the same box as initGrid
+  vec3 gridSize = (mesh.max + rangeOffset) - gridOrigin;
+  nOfCells = ivec3(gridSize / cellSize);
+
+  string fileName;
+  if (shardLo.x < 0) {
+    if (shardIndex < 0 || shardIndex >= nOfShards) {
+      std::cout << "shard " << shardIndex << " of " << nOfShards
+                << " does not exist" << '\n';
+      return;
+    }
+
+    shardLo = ivec3(0, 0, int(int64_t(nOfCells.z) * shardIndex / nOfShards));
+    shardHi = ivec3(nOfCells.x, nOfCells.y,
+                    int(int64_t(nOfCells.z) * (shardIndex + 1) / nOfShards));
+    fileName = "sdf" + to_string(shardIndex) + "of" + to_string(nOfShards) +
+               ".shard";
+  } else {
+    shardLo = clamp(shardLo, ivec3(0), nOfCells);
+    shardHi = clamp(shardHi, shardLo, nOfCells);
+    fileName = "sdf" + to_string(shardLo.x) + "_" + to_string(shardLo.y) +
+               "_" + to_string(shardLo.z) + ".shard";
+  }
+
+  double start = glfwGetTime();
+
+  MeshBvh bvh;
+  bvh.build(mesh);
+
+  Shard shard;
+  shard.meshHash = hashFile(meshFile);
+  shard.nOfCells = nOfCells;
+  shard.origin = gridOrigin;
+  shard.cellSize = cellSize;
+  shard.lo = shardLo;
+  shard.hi = shardHi;
+
+  ivec3 size = shardHi - shardLo;
+  size_t n = size_t(size.x) * size.y * size.z;
+  shard.sd.resize(n);
+  shard.faceIds.resize(n);
+
+  // row by row
+  parallelFor(size.y * size.z, [&](int begin, int end) {
+    for (int r = begin; r < end; r++) {
+      int j = r % size.y;
+      int k = r / size.y;
+      size_t row = size_t(r) * size.x;
+
+      for (int i = 0; i < size.x; i++) {
+        ivec3 idx = shardLo + ivec3(i, j, k);
+        MeshQuery q = bvh.query(vec3(idx) * cellSize + gridOrigin);
+        shard.sd[row + i] = q.distance;
+        shard.faceIds[row + i] = q.face;
+      }
+    }
+  });
+
+  writeShard(shard, fileName);
+
+  std::cout << "cells (" << shardLo.x << ", " << shardLo.y << ", "
+            << shardLo.z << ") to (" << shardHi.x << ", " << shardHi.y << ", "
+            << shardHi.z << ") written to " << fileName << " in "
+            << glfwGetTime() - start << " s" << '\n';
+}
+
 // calculate the position of the cell which covers the specified point
 vec3 calCellPos(vec3 pt) {
   // change reference frame
@@ -128,42 +988,19 @@ void initGrid() {
       } // end of iterate x
     }   // end of iterate y
   }     // end of iterate z
-}
-
-// format: x, y, z, i, j, k, dist
-void writeSdf(Grid &gd, const string fileName) {
-  ofstream output(fileName);
-
-  for (size_t i = 0; i < gd.cells.size(); i++) {
-    Cell &cell = gd.cells[i];
 
-    output << cell.pos.x;
-    output << " ";
-    output << cell.pos.y;
-    output << " ";
-    output << cell.pos.z;
-    output << " ";
-    output << cell.idx.x;
-    output << " ";
-    output << cell.idx.y;
-    output << " ";
-    output << cell.idx.z;
-    output << " ";
-    output << cell.sd;
-    output << '\n';
-  }
-
-  output.close();
+  // closest face per cell, written as the last column of sdf.txt
+  grid.faceIds.assign(grid.cells.size(), -1);
 }
 
 void initMesh() {
   /* prepare mesh data */
-  mesh = loadObj("./mesh/bunny.obj");
+  mesh = loadObj(meshFile);
   findAABB(mesh);
 
   // transform mesh to (origin + offset) position
-  vec3 offset = (gridOrigin - mesh.min) + rangeOffset;
-  mesh.translate(offset);
+  meshOffset = (gridOrigin - mesh.min) + rangeOffset;
+  mesh.translate(meshOffset);
 }
 
 void initOther() { srand(clock()); }
@@ -0,0 +1,163 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "frameWriter.h"
+
+// prefix + zero padded number + ".bmp", e.g. "./result/output0001.bmp"
+std::string frameFileName(const std::string prefix, unsigned number) {
+  std::string num = std::to_string(number);
+  num = std::string(std::max(4 - int(num.length()), 0), '0') + num;
+
+  return prefix + num + ".bmp";
+}
+
+// 32 bit uncompressed BMP, rows bottom-up as stored
+static void encodeBmp(const uint8_t *pixels, int width, int height,
+                      std::vector<uint8_t> &out) {
+  const uint32_t headerSize = 14 + 40;
+  uint32_t imageSize = uint32_t(width) * uint32_t(height) * 4;
+
+  out.resize(headerSize + imageSize);
+  uint8_t *p = out.data();
+  std::memset(p, 0, headerSize);
+
+  auto put16 = [&](size_t at, uint16_t v) { std::memcpy(p + at, &v, 2); };
+  auto put32 = [&](size_t at, uint32_t v) { std::memcpy(p + at, &v, 4); };
+
+  // file header
+  p[0] = 'B';
+  p[1] = 'M';
+  put32(2, headerSize + imageSize);
+  put32(10, headerSize);
+
+  // info header
+  put32(14, 40);
+  put32(18, uint32_t(width));
+  put32(22, uint32_t(height)); // positive, bottom-up
+  put16(26, 1);                // planes
+  put16(28, 32);               // bits per pixel
+  put32(34, imageSize);
+  put32(38, 2835); // 72 dpi
+  put32(42, 2835);
+
+  std::memcpy(p + headerSize, pixels, imageSize);
+}
+
+/* Member functions of FrameWriter */
+// frames are numbered from 0 in submission order
+void FrameWriter::start(const std::string filePrefix, int w, int h,
+                        int nOfThreads, int nOfBuffers) {
+  finish();
+
+  prefix = filePrefix;
+  width = w;
+  height = h;
+
+  buffers.resize(std::max(nOfBuffers, 1));
+  numbers.resize(buffers.size());
+  freeList.clear();
+  for (size_t b = 0; b < buffers.size(); b++) {
+    buffers[b].resize(size_t(width) * height * 4);
+    freeList.push_back(int(b));
+  }
+  queue.clear();
+
+  nextNumber = 0;
+  nextToWrite = 0;
+  nOfWritten = 0;
+  nOfStalls = 0;
+  stopping = false;
+
+  for (int t = 0; t < std::max(nOfThreads, 1); t++) {
+    encoders.push_back(std::thread(&FrameWriter::encoderLoop, this));
+  }
+}
+
+// a free buffer, owned by the caller until submit()
+int FrameWriter::acquire() {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (freeList.empty()) {
+    nOfStalls++;
+    notFull.wait(lock, [this] { return !freeList.empty(); });
+  }
+
+  int b = freeList.back();
+  freeList.pop_back();
+
+  return b;
+}
+
+uint8_t *FrameWriter::getPixels(int b) { return buffers[b].data(); }
+
+void FrameWriter::submit(int b) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    numbers[b] = nextNumber++;
+    queue.push_back(b);
+  }
+  notEmpty.notify_one();
+}
+
+// write every submitted frame, then stop the encoders
+void FrameWriter::finish() {
+  if (encoders.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  notEmpty.notify_all();
+
+  for (size_t t = 0; t < encoders.size(); t++) {
+    encoders[t].join();
+  }
+  encoders.clear();
+}
+
+// Frames are taken from the queue in number order, so the frame whose
+// turn it is has always been taken by some encoder already.
+void FrameWriter::encoderLoop() {
+  std::vector<uint8_t> encoded; // reused between frames
+
+  while (true) {
+    std::unique_lock<std::mutex> lock(mtx);
+    notEmpty.wait(lock, [this] { return !queue.empty() || stopping; });
+    if (queue.empty()) {
+      return; // stopping, and nothing left
+    }
+    int b = queue.front();
+    queue.pop_front();
+    unsigned number = numbers[b];
+    lock.unlock();
+
+    encodeBmp(buffers[b].data(), width, height, encoded);
+
+    // the buffer can be reused as soon as it is encoded
+    lock.lock();
+    freeList.push_back(b);
+    lock.unlock();
+    notFull.notify_one();
+
+    // wait for the previous frame to be written
+    lock.lock();
+    turn.wait(lock, [&] { return nextToWrite == number; });
+    lock.unlock();
+
+    std::string fileName = frameFileName(prefix, number);
+    std::ofstream output(fileName, std::ios::binary);
+    output.write(reinterpret_cast<const char *>(encoded.data()),
+                 encoded.size());
+    if (!(output.good())) {
+      std::cout << "failed to write file : " << fileName << std::endl;
+    }
+    output.close();
+
+    lock.lock();
+    nextToWrite++;
+    nOfWritten++;
+    lock.unlock();
+    turn.notify_all();
+  }
+}
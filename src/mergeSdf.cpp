@@ -0,0 +1,118 @@
+#include "sdf.h"
+
+// Assembles the shards written by createSdf shard into one grid.
+//
+// usage: mergeSdf [outFile] [shardFile]...
+//   outFile   : the merged grid in the format of writeSdf
+//   shardFile : shards of the same grid, in any order
+//
+// All shards must come from the same mesh and grid, and every cell of the
+// grid must be covered by a shard, otherwise nothing is written and the
+// missing cells are reported. Shards may overlap, as long as they agree on
+// the overlapping cells; if any overlapping cell differs, nothing is
+// written either.
+
+int main(int argc, char const *argv[]) {
+  if (argc < 3) {
+    std::cout << "usage: mergeSdf outFile shardFile..." << '\n';
+    return 1;
+  }
+
+  string outFile = argv[1];
+
+  Grid grid;
+  uint64_t meshHash = 0;
+  vector<char> covered;
+  size_t nOfCovered = 0, nOfOverlapping = 0, nOfMismatched = 0;
+
+  for (int a = 2; a < argc; a++) {
+    Shard shard;
+    if (!readShard(shard, argv[a])) {
+      return 1;
+    }
+
+    // the first shard decides the grid
+    if (covered.empty()) {
+      meshHash = shard.meshHash;
+      grid.nOfCells = shard.nOfCells;
+      grid.origin = shard.origin;
+      grid.cellSize = shard.cellSize;
+
+      size_t n = size_t(grid.nOfCells.x) * grid.nOfCells.y * grid.nOfCells.z;
+      grid.cells.resize(n);
+      grid.faceIds.assign(n, -1);
+      covered.assign(n, 0);
+    } else if (shard.meshHash != meshHash) {
+      std::cout << argv[a] << " belongs to another mesh" << '\n';
+      return 1;
+    } else if (shard.nOfCells != grid.nOfCells ||
+               shard.origin != grid.origin ||
+               shard.cellSize != grid.cellSize) {
+      std::cout << argv[a] << " belongs to another grid" << '\n';
+      return 1;
+    }
+
+    ivec3 size = shard.hi - shard.lo;
+    ivec3 n = grid.nOfCells;
+    size_t s = 0;
+
+    for (int k = shard.lo.z; k < shard.hi.z; k++) {
+      for (int j = shard.lo.y; j < shard.hi.y; j++) {
+        for (int i = shard.lo.x; i < shard.hi.x; i++, s++) {
+          size_t h = i + size_t(n.x) * (j + size_t(n.y) * k);
+
+          if (covered[h]) {
+            nOfOverlapping++;
+            if (grid.cells[h].sd != shard.sd[s] ||
+                grid.faceIds[h] != shard.faceIds[s]) {
+              nOfMismatched++;
+            }
+            continue;
+          }
+
+          Cell &cell = grid.cells[h];
+          cell.idx = ivec3(i, j, k);
+          cell.pos = vec3(cell.idx) * grid.cellSize + grid.origin;
+          cell.sd = shard.sd[s];
+          grid.faceIds[h] = shard.faceIds[s];
+
+          covered[h] = 1;
+          nOfCovered++;
+        }
+      }
+    }
+
+    std::cout << argv[a] << " : " << size.x << " x " << size.y << " x "
+              << size.z << " cells" << '\n';
+  }
+
+  if (nOfMismatched > 0) {
+    std::cout << nOfMismatched << " of " << nOfOverlapping
+              << " overlapping cells differ between shards, nothing written"
+              << '\n';
+    return 1;
+  }
+
+  if (nOfCovered < covered.size()) {
+    // the box around the missing cells tells which shard is missing
+    ivec3 n = grid.nOfCells;
+    ivec3 lo = n, hi(-1);
+    for (size_t h = 0; h < covered.size(); h++) {
+      if (!covered[h]) {
+        ivec3 idx(int(h % n.x), int(h / n.x % n.y), int(h / n.x / n.y));
+        lo = min(lo, idx);
+        hi = max(hi, idx);
+      }
+    }
+
+    std::cout << covered.size() - nOfCovered << " cells are not covered, in ("
+              << lo.x << ", " << lo.y << ", " << lo.z << ") to (" << hi.x
+              << ", " << hi.y << ", " << hi.z << "), nothing written" << '\n';
+    return 1;
+  }
+
+  writeSdf(grid, outFile);
+  std::cout << covered.size() << " cells written to " << outFile << '\n';
+
+  return 0;
+}
@@ -0,0 +1,333 @@
+#include "meshBvh.h"
+
+// two closest points closer than this are a tie,
+// the same tolerance as the brute force loop in createSdf
+static const float tieEpsilon = 0.0001f;
+
+// squared distance from p to a box, 0 inside
+static inline float boxDistance2(vec3 p, vec3 boxMin, vec3 boxMax) {
+  vec3 d = max(max(boxMin - p, p - boxMax), vec3(0.f));
+  return dot(d, d);
+}
+
+static inline float surfaceArea(vec3 boxMin, vec3 boxMax) {
+  vec3 e = max(boxMax - boxMin, vec3(0.f));
+  return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+}
+
+/* Member functions of MeshBvh */
+void MeshBvh::build(const Mesh &mesh) {
+  tris.resize(mesh.faces.size());
+  vector<vec3> centers(tris.size());
+
+  for (size_t i = 0; i < tris.size(); i++) {
+    const Face &face = mesh.faces[i];
+    Tri &tri = tris[i];
+    tri.a = mesh.vertices[face.v1];
+    tri.b = mesh.vertices[face.v2];
+    tri.c = mesh.vertices[face.v3];
+    tri.n = mesh.faceNormals[face.vn1];
+    tri.face = int(i);
+    centers[i] = (tri.a + tri.b + tri.c) / 3.f;
+  }
+
+  nodes.clear();
+  if (!tris.empty()) {
+    buildNode(0, int(tris.size()), centers);
+  }
+
+  triOfFace.resize(tris.size());
+  for (size_t i = 0; i < tris.size(); i++) {
+    triOfFace[tris[i].face] = int(i);
+  }
+}
+
+// Top-down build with binned SAH
+// The centers are put into bins along each axis, and the node is split at
+// the bin boundary with the lowest area(L) * nL + area(R) * nR. A node
+// becomes a leaf when no split is cheaper than testing all of its
+// triangles.
+int MeshBvh::buildNode(int first, int count, vector<vec3> &centers) {
+  int id = int(nodes.size());
+  nodes.push_back(BvhNode());
+
+  vec3 bmin(9999.f), bmax(-9999.f), cmin(9999.f), cmax(-9999.f);
+  for (int i = first; i < first + count; i++) {
+    bmin = min(bmin, min(tris[i].a, min(tris[i].b, tris[i].c)));
+    bmax = max(bmax, max(tris[i].a, max(tris[i].b, tris[i].c)));
+    cmin = min(cmin, centers[i]);
+    cmax = max(cmax, centers[i]);
+  }
+
+  nodes[id].min = bmin;
+  nodes[id].max = bmax;
+  nodes[id].first = first;
+  nodes[id].count = count;
+  nodes[id].left = -1;
+  nodes[id].right = -1;
+
+  const int leafSize = 4;
+  if (count <= leafSize) {
+    return id;
+  }
+
+  const int nOfBins = 12;
+  float bestCost = float(count) * surfaceArea(bmin, bmax);
+  int bestAxis = -1, bestSplit = 0;
+
+  for (int axis = 0; axis < 3; axis++) {
+    float extent = cmax[axis] - cmin[axis];
+    if (extent <= 0.f) {
+      continue;
+    }
+
+    int binCount[nOfBins] = {0};
+    vec3 binMin[nOfBins], binMax[nOfBins];
+    for (int b = 0; b < nOfBins; b++) {
+      binMin[b] = vec3(9999.f);
+      binMax[b] = vec3(-9999.f);
+    }
+
+    for (int i = first; i < first + count; i++) {
+      int b = int((centers[i][axis] - cmin[axis]) / extent * nOfBins);
+      b = std::min(b, nOfBins - 1);
+      binCount[b]++;
+      binMin[b] = min(binMin[b], min(tris[i].a, min(tris[i].b, tris[i].c)));
+      binMax[b] = max(binMax[b], max(tris[i].a, max(tris[i].b, tris[i].c)));
+    }
+
+    // sweep from the right, then evaluate every split from the left
+    float rightArea[nOfBins];
+    int rightCount[nOfBins];
+    vec3 rmin(9999.f), rmax(-9999.f);
+    int n = 0;
+    for (int b = nOfBins - 1; b > 0; b--) {
+      rmin = min(rmin, binMin[b]);
+      rmax = max(rmax, binMax[b]);
+      n += binCount[b];
+      rightArea[b] = surfaceArea(rmin, rmax);
+      rightCount[b] = n;
+    }
+
+    vec3 lmin(9999.f), lmax(-9999.f);
+    n = 0;
+    for (int b = 0; b < nOfBins - 1; b++) {
+      lmin = min(lmin, binMin[b]);
+      lmax = max(lmax, binMax[b]);
+      n += binCount[b];
+      if (n == 0 || rightCount[b + 1] == 0) {
+        continue;
+      }
+
+      float cost = surfaceArea(lmin, lmax) * n +
+                   rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestSplit = b + 1;
+      }
+    }
+  }
+
+  if (bestAxis < 0) {
+    return id;
+  }
+
+  // partition triangles and centers together
+  float extent = cmax[bestAxis] - cmin[bestAxis];
+  int mid = first;
+  for (int i = first; i < first + count; i++) {
+    int b = int((centers[i][bestAxis] - cmin[bestAxis]) / extent * nOfBins);
+    if (std::min(b, nOfBins - 1) < bestSplit) {
+      std::swap(tris[i], tris[mid]);
+      std::swap(centers[i], centers[mid]);
+      mid++;
+    }
+  }
+
+  int left = buildNode(first, mid - first, centers);
+  int right = buildNode(mid, first + count - mid, centers);
+  nodes[id].left = left;
+  nodes[id].right = right;
+
+  return id;
+}
+
+void MeshBvh::refit(const Mesh &mesh) {
+  for (size_t i = 0; i < tris.size(); i++) {
+    Tri &tri = tris[i];
+    const Face &face = mesh.faces[tri.face];
+    tri.a = mesh.vertices[face.v1];
+    tri.b = mesh.vertices[face.v2];
+    tri.c = mesh.vertices[face.v3];
+    tri.n = mesh.faceNormals[face.vn1];
+  }
+
+  if (nodes.size() > 0) {
+    refitNode(0);
+  }
+}
+
+void MeshBvh::refitNode(int id) {
+  BvhNode &node = nodes[id];
+
+  if (node.left < 0) {
+    node.min = vec3(9999.f);
+    node.max = vec3(-9999.f);
+    for (int i = node.first; i < node.first + node.count; i++) {
+      node.min = min(node.min, min(tris[i].a, min(tris[i].b, tris[i].c)));
+      node.max = max(node.max, max(tris[i].a, max(tris[i].b, tris[i].c)));
+    }
+    return;
+  }
+
+  refitNode(node.left);
+  refitNode(node.right);
+  node.min = min(nodes[node.left].min, nodes[node.right].min);
+  node.max = max(nodes[node.left].max, nodes[node.right].max);
+}
+
+static MeshQuery emptyQuery() {
+  MeshQuery q;
+  q.distance = 9999.f;
+  q.point = vec3(0.f);
+  q.bary = vec3(0.f);
+  q.face = -1;
+
+  return q;
+}
+
+// replace best by the triangle if it is closer, bound tracks |best|
+void MeshBvh::testTriangle(const Tri &tri, vec3 p, float maxDist,
+                           MeshQuery &best, float &bound) const {
+  vec3 bary;
+  vec3 q = closestPoint2Triangle(tri.a, tri.b, tri.c, p, bary);
+  float dist = length(p - q);
+  if (dist > maxDist) {
+    return;
+  }
+  float sd = dist * sideSign(tri.a, tri.n, p);
+
+  // closer wins; on a tie, e.g. at an edge shared by two faces,
+  // the positive distance wins, as in createSdf
+  bool closer;
+  if (best.face < 0) {
+    closer = true;
+  } else if (abs(dist - abs(best.distance)) < tieEpsilon) {
+    closer = (sd > 0.f && best.distance < 0.f);
+  } else {
+    closer = (dist < abs(best.distance));
+  }
+
+  if (closer) {
+    best.distance = sd;
+    best.point = q;
+    best.bary = bary;
+    best.face = tri.face;
+    bound = std::min(bound, dist);
+  }
+}
+
+MeshQuery MeshBvh::query(vec3 p, float maxDist, int hint) const {
+  MeshQuery best = emptyQuery();
+
+  if (nodes.empty()) {
+    return best;
+  }
+
+  float bound = maxDist; // unsigned distance of best, or the range
+
+  if (hint >= 0 && hint < int(triOfFace.size())) {
+    testTriangle(tris[triOfFace[hint]], p, maxDist, best, bound);
+  }
+
+  // nodes to visit, the nearer child on top
+  // reused by every query of the thread, so a query allocates nothing
+  static thread_local vector<int> stack;
+  stack.clear();
+  stack.push_back(0);
+
+  while (!stack.empty()) {
+    const BvhNode &node = nodes[stack.back()];
+    stack.pop_back();
+
+    // the bound may have shrunk since the node was pushed
+    float reach = bound + tieEpsilon;
+    if (boxDistance2(p, node.min, node.max) > reach * reach) {
+      continue;
+    }
+
+    if (node.left >= 0) {
+      float dl = boxDistance2(p, nodes[node.left].min, nodes[node.left].max);
+      float dr = boxDistance2(p, nodes[node.right].min, nodes[node.right].max);
+      bool leftFirst = (dl <= dr);
+      stack.push_back(leftFirst ? node.right : node.left);
+      stack.push_back(leftFirst ? node.left : node.right);
+      continue;
+    }
+
+    for (int i = node.first; i < node.first + node.count; i++) {
+      testTriangle(tris[i], p, maxDist, best, bound);
+    }
+  }
+
+  return best;
+}
+
+MeshQuery MeshBvh::queryFace(vec3 p, int face) const {
+  MeshQuery result = emptyQuery();
+
+  if (face >= 0 && face < int(triOfFace.size())) {
+    float bound = 9999.f;
+    testTriangle(tris[triOfFace[face]], p, 9999.f, result, bound);
+  }
+
+  return result;
+}
+
+void MeshBvh::query(const vector<vec3> &points, vector<MeshQuery> &results,
+                    float maxDist) const {
+  results.resize(points.size());
+
+  getThreadPool().parallelFor(
+      points.size(), 256, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          results[i] = query(points[i], maxDist);
+        }
+      });
+}
+
+// depth first, any triangle will do
+bool MeshBvh::isWithin(vec3 p, float radius) const {
+  if (nodes.empty()) {
+    return false;
+  }
+
+  float r2 = radius * radius;
+  vector<int> stack(1, 0);
+
+  while (!stack.empty()) {
+    const BvhNode &node = nodes[stack.back()];
+    stack.pop_back();
+    if (boxDistance2(p, node.min, node.max) > r2) {
+      continue;
+    }
+
+    if (node.left >= 0) {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+      continue;
+    }
+
+    for (int i = node.first; i < node.first + node.count; i++) {
+      const Tri &tri = tris[i];
+      vec3 bary;
+      vec3 q = closestPoint2Triangle(tri.a, tri.b, tri.c, p, bary);
+      if (dot(p - q, p - q) <= r2) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
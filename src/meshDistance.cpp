@@ -0,0 +1,97 @@
+#include <chrono>
+#include "common.h"
+#include "meshBvh.h"
+
+// Exact signed distances from points to a mesh, without a grid.
+//
+// usage: meshDistance [meshFile] [pointFile] [outFile] [maxDist]
+//   meshFile  : .obj with surface normals, ./mesh/bunny.obj by default
+//   pointFile : x, y, z per line, particles.txt by default
+//   outFile   : one line per point, distances.txt by default
+//               distance, closest point x y z, face, barycentrics u v w
+//               face is -1 and distance 9999 if nothing is within maxDist
+//   maxDist   : ignore the surface further than this, 9999 by default
+
+void readPoints(vector<vec3> &, const string);
+void writeResults(const vector<MeshQuery> &, const string);
+
+int main(int argc, char const *argv[]) {
+  string meshFile = "./mesh/bunny.obj";
+  string pointFile = "particles.txt";
+  string outFile = "distances.txt";
+  float maxDist = 9999.f;
+
+  if (argc > 1) {
+    meshFile = argv[1];
+  }
+  if (argc > 2) {
+    pointFile = argv[2];
+  }
+  if (argc > 3) {
+    outFile = argv[3];
+  }
+  if (argc > 4) {
+    maxDist = float(atof(argv[4]));
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  typedef std::chrono::duration<double, std::milli> Ms;
+
+  // no window, loadObj does not need GL
+  Mesh mesh = loadObj(meshFile);
+
+  Clock::time_point start = Clock::now();
+  MeshBvh bvh;
+  bvh.build(mesh);
+  double buildTime = Ms(Clock::now() - start).count();
+
+  vector<vec3> points;
+  readPoints(points, pointFile);
+
+  start = Clock::now();
+  vector<MeshQuery> results;
+  bvh.query(points, results, maxDist);
+  double queryTime = Ms(Clock::now() - start).count();
+
+  writeResults(results, outFile);
+
+  std::cout << bvh.size() << " triangles, " << bvh.nodes.size()
+            << " nodes, built in " << buildTime << " ms" << '\n';
+  std::cout << points.size() << " points in " << queryTime << " ms ("
+            << queryTime * 1000.0 / std::max(points.size(), size_t(1))
+            << " us per point)" << '\n';
+
+  return 0;
+}
+
+// format: x, y, z per line
+void readPoints(vector<vec3> &points, const string fileName) {
+  ifstream ifs(fileName);
+
+  if (!(ifs.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+  }
+
+  vec3 p;
+  while (ifs >> p.x >> p.y >> p.z) {
+    points.push_back(p);
+  }
+
+  ifs.close();
+}
+
+void writeResults(const vector<MeshQuery> &results, const string fileName) {
+  ofstream output(fileName);
+
+  if (!(output.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+  }
+
+  for (const MeshQuery &r : results) {
+    output << r.distance << " " << r.point.x << " " << r.point.y << " "
+           << r.point.z << " " << r.face << " " << r.bary.x << " "
+           << r.bary.y << " " << r.bary.z << '\n';
+  }
+
+  output.close();
+}
@@ -0,0 +1,299 @@
+#include "particles.h"
+#include "collider.h"
+#include "sparseGrid.h"
+
+/* Member functions of ParticleSoA */
+void ParticleSoA::resize(size_t n) {
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  vx.resize(n);
+  vy.resize(n);
+  vz.resize(n);
+  m.resize(n);
+}
+
+void ParticleSoA::add(vec3 pos, vec3 v, float mass) {
+  x.push_back(pos.x);
+  y.push_back(pos.y);
+  z.push_back(pos.z);
+  vx.push_back(v.x);
+  vy.push_back(v.y);
+  vz.push_back(v.z);
+  m.push_back(mass);
+}
+
+vec3 ParticleSoA::getPos(size_t i) const { return vec3(x[i], y[i], z[i]); }
+
+vec3 ParticleSoA::getVelocity(size_t i) const {
+  return vec3(vx[i], vy[i], vz[i]);
+}
+
+// Continuous version of stepParticles
+// Each particle sweeps the segment it would travel in this step through the
+// field. At the first contact it stops there, its velocity is reflected and
+// damped as in the discrete step, and it moves on for the rest of the step
+// unless that second segment hits the surface as well.
+// The trace samples the field, so a step may still end inside the surface
+// near thin parts and sharp edges. Such a step is undone: the particle
+// goes back to the last point of the step known to be outside, and a
+// velocity into the surface there is reflected.
+template <class Field>
+static void stepParticlesContinuous(ParticleSoA &ps, const Field &grid,
+                                    const SimParams &params, size_t begin,
+                                    size_t end) {
+  float dt = params.dt;
+
+  for (size_t i = begin; i < end; i++) {
+    vec3 p = ps.getPos(i);
+    vec3 v = ps.getVelocity(i) + dt * params.g;
+
+    // already inside, push it out as the discrete step does
+    float d;
+    grid.getDistances(&p.x, &p.y, &p.z, &d, 1);
+    if (d < 0.f) {
+      vec3 n;
+      grid.getGradients(&p.x, &p.y, &p.z, &n.x, &n.y, &n.z, 1);
+      p += d * 2.f * n;
+    }
+    vec3 safe = p;
+
+    float toi;
+    vec3 n;
+    if (grid.traceSegment(p, p + dt * v, params.threshold, toi, n)) {
+      // move to the contact, then respond
+      p += toi * dt * v;
+      safe = p;
+      if (dot(v, n) < 0.f) {
+        v = (v - 2.f * dot(v, n) * n) * params.friction;
+      }
+
+      // the rest of the step
+      float rest = (1.f - toi) * dt;
+      vec3 next = p + rest * v;
+      float toi2;
+      vec3 n2;
+      if (grid.traceSegment(p, next, params.threshold, toi2, n2)) {
+        next = p + toi2 * rest * v;
+      }
+      p = next;
+    } else {
+      p += dt * v;
+    }
+
+    grid.getDistances(&p.x, &p.y, &p.z, &d, 1);
+    if (d < 0.f) {
+      p = safe;
+      vec3 g; // points into the object
+      grid.getGradients(&p.x, &p.y, &p.z, &g.x, &g.y, &g.z, 1);
+      if (dot(v, g) > 0.f) {
+        v = (v - 2.f * dot(v, g) * g) * params.friction;
+      }
+    }
+
+    ps.x[i] = p.x;
+    ps.y[i] = p.y;
+    ps.z[i] = p.z;
+    ps.vx[i] = v.x;
+    ps.vy[i] = v.y;
+    ps.vz[i] = v.z;
+  }
+}
+
+// Advance particles in [begin, end) by one time step.
+// The scheme is the same as the original per-particle loop:
+//   1. apply gravity
+//   2. near the surface, reflect the velocity and damp it
+//   3. move
+//   4. if a particle has moved into the object, push it out
+// Particles are processed in blocks so that every stage is a flat loop over
+// arrays. Colliding particles are first compacted into an index list,
+// so gradients are only sampled where they are needed.
+template <class Field>
+void stepParticles(ParticleSoA &ps, const Field &grid, const SimParams &params,
+                   size_t begin, size_t end) {
+  if (params.continuous) {
+    stepParticlesContinuous(ps, grid, params, begin, end);
+    return;
+  }
+
+  const int blockSize = 256;
+
+  float dist[blockSize];
+  int hit[blockSize];                               // compacted indices
+  float cx[blockSize], cy[blockSize], cz[blockSize]; // compacted positions
+  float nx[blockSize], ny[blockSize], nz[blockSize]; // surface normals
+
+  float dt = params.dt;
+  vec3 dv = params.dt * params.g;
+
+  for (size_t first = begin; first < end; first += blockSize) {
+    int count = int(std::min(size_t(blockSize), end - first));
+
+    float *__restrict x = ps.x.data() + first;
+    float *__restrict y = ps.y.data() + first;
+    float *__restrict z = ps.z.data() + first;
+    float *__restrict vx = ps.vx.data() + first;
+    float *__restrict vy = ps.vy.data() + first;
+    float *__restrict vz = ps.vz.data() + first;
+
+    // gravity
+    for (int i = 0; i < count; i++) {
+      vx[i] += dv.x;
+      vy[i] += dv.y;
+      vz[i] += dv.z;
+    }
+
+    // collision detection
+    grid.getDistances(x, y, z, dist, count);
+
+    int nOfHits = 0;
+    for (int i = 0; i < count; i++) {
+      hit[nOfHits] = i;
+      nOfHits += (dist[i] < params.threshold);
+    }
+
+    for (int k = 0; k < nOfHits; k++) {
+      cx[k] = x[hit[k]];
+      cy[k] = y[hit[k]];
+      cz[k] = z[hit[k]];
+    }
+    grid.getGradients(cx, cy, cz, nx, ny, nz, nOfHits);
+
+    // v = (vVer + vHor) * fric
+    // where vVer = -dot(v, n) * n, vHor = v - dot(v, n) * n
+    for (int k = 0; k < nOfHits; k++) {
+      int i = hit[k];
+      float vn = vx[i] * nx[k] + vy[i] * ny[k] + vz[i] * nz[k];
+      vx[i] = (vx[i] - 2.f * vn * nx[k]) * params.friction;
+      vy[i] = (vy[i] - 2.f * vn * ny[k]) * params.friction;
+      vz[i] = (vz[i] - 2.f * vn * nz[k]) * params.friction;
+    }
+
+    // update position
+    for (int i = 0; i < count; i++) {
+      x[i] += dt * vx[i];
+      y[i] += dt * vy[i];
+      z[i] += dt * vz[i];
+    }
+
+    // if a particle has moved into an object
+    // push it out
+    grid.getDistances(x, y, z, dist, count);
+
+    nOfHits = 0;
+    for (int i = 0; i < count; i++) {
+      hit[nOfHits] = i;
+      nOfHits += (dist[i] < 0.f);
+    }
+
+    for (int k = 0; k < nOfHits; k++) {
+      cx[k] = x[hit[k]];
+      cy[k] = y[hit[k]];
+      cz[k] = z[hit[k]];
+    }
+    grid.getGradients(cx, cy, cz, nx, ny, nz, nOfHits);
+
+    for (int k = 0; k < nOfHits; k++) {
+      int i = hit[k];
+      float d = dist[i] * 2.f; // for visualization convenience
+      x[i] += d * nx[k];
+      y[i] += d * ny[k];
+      z[i] += d * nz[k];
+    }
+  } // end iterating blocks
+}
+
+// Particles are split into chunks of whole blocks.
+// Each particle only reads the grid and writes its own state,
+// so the result does not depend on the number of threads.
+template <class Field>
+void stepParticlesParallel(ParticleSoA &ps, const Field &grid,
+                           const SimParams &params, ThreadPool &pool) {
+  const size_t chunk = 16384;
+
+  pool.parallelFor(ps.size(), chunk, [&](size_t begin, size_t end) {
+    stepParticles(ps, grid, params, begin, end);
+  });
+}
+
+template void stepParticles(ParticleSoA &, const Grid &, const SimParams &,
+                            size_t, size_t);
+template void stepParticles(ParticleSoA &, const ColliderScene &,
+                            const SimParams &, size_t, size_t);
+template void stepParticles(ParticleSoA &, const SparseGrid &,
+                            const SimParams &, size_t, size_t);
+template void stepParticlesParallel(ParticleSoA &, const Grid &,
+                                    const SimParams &, ThreadPool &);
+template void stepParticlesParallel(ParticleSoA &, const ColliderScene &,
+                                    const SimParams &, ThreadPool &);
+template void stepParticlesParallel(ParticleSoA &, const SparseGrid &,
+                                    const SimParams &, ThreadPool &);
+
+// Counter-based random number in [0, 1]
+// The same (seed, index, stream) always gives the same number,
+// so the initial state is reproducible no matter who computes it.
+// splitmix64 finalizer
+float hashRandf(unsigned seed, unsigned index, unsigned stream) {
+  unsigned long long h = (unsigned long long)seed << 32;
+  h ^= (unsigned long long)index * 0x9E3779B97F4A7C15ull + stream;
+
+  h ^= h >> 30;
+  h *= 0xBF58476D1CE4E5B9ull;
+  h ^= h >> 27;
+  h *= 0x94D049BB133111EBull;
+  h ^= h >> 31;
+
+  // top 24 bits fit exactly in a float
+  return float(h >> 40) / float((1 << 24) - 1);
+}
+
+// format: x, y, z per line
+// velocity and mass are drawn from hashRandf with the given seed
+void loadParticles(ParticleSoA &ps, const string fileName, vec3 offset,
+                   unsigned seed) {
+  // read point information from file
+  ifstream ifs(fileName);
+
+  if (!(ifs.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+  }
+
+  while (ifs.peek() != EOF) {
+    float x, y, z;
+
+    ifs >> x;
+    ifs >> y;
+    ifs >> z;
+
+    // ignore '\n'
+    // otherwise, the last empty line will be read
+    ifs.ignore(1);
+
+    unsigned i = unsigned(ps.size());
+    vec3 pos = vec3(x, y, z) + offset;
+    vec3 v = vec3(hashRandf(seed, i, 0) - 0.5f, hashRandf(seed, i, 1) - 0.5f,
+                  hashRandf(seed, i, 2) - 0.5f);
+    float m = hashRandf(seed, i, 3);
+
+    ps.add(pos, v, m);
+  }
+
+  ifs.close();
+}
+
+// format: x, y, z, vx, vy, vz per line
+void writeParticles(const ParticleSoA &ps, const string fileName) {
+  ofstream output(fileName);
+
+  if (!(output.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+  }
+
+  for (size_t i = 0; i < ps.size(); i++) {
+    output << ps.x[i] << " " << ps.y[i] << " " << ps.z[i] << " ";
+    output << ps.vx[i] << " " << ps.vy[i] << " " << ps.vz[i] << '\n';
+  }
+
+  output.close();
+}
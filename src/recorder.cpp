@@ -0,0 +1,371 @@
+#include <cstring>
+#include "binaryIo.h"
+#include "recorder.h"
+
+static const char recorderMagic[4] = {'S', 'D', 'F', 'R'};
+static const char indexMagic[4] = {'S', 'D', 'F', 'I'};
+static const uint32_t recorderVersion = 1;
+
+static const uint8_t keyFrame = 0;
+static const uint8_t deltaFrame = 1;
+
+// bytes of a frame record before its payload: type, step, payload size
+static const size_t frameHeaderSize = 1 + 4 + 4;
+// bytes after the frame offsets: nOfFrames, index offset, magic
+static const size_t trailerSize = 8 + 8 + 4;
+
+/* Helpers for the byte stream */
+// small magnitudes of either sign become small unsigned numbers
+static inline uint32_t zigzag(int32_t v) {
+  return (uint32_t(v) << 1) ^ uint32_t(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+  return int32_t(v >> 1) ^ -int32_t(v & 1);
+}
+
+// 7 bits per byte, the high bit marks that more bytes follow
+static inline void putVarint(vector<uint8_t> &out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back(uint8_t(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(uint8_t(v));
+}
+
+// false if the varint runs past end or over 5 bytes
+static inline bool getVarint(const uint8_t *&p, const uint8_t *end,
+                             uint32_t &v) {
+  v = 0;
+  for (int shift = 0; shift < 35 && p < end; shift += 7) {
+    uint8_t b = *p++;
+    v |= uint32_t(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// NaN becomes 0, and the magnitude is limited so that the difference of
+// two quantized values still fits into an int32
+static inline int32_t quantize(float v, float quantum) {
+  const double limit = double((1 << 30) - 1);
+  double q = double(v) / quantum;
+  if (!(std::abs(q) <= limit)) {
+    q = std::isnan(q) ? 0.0 : std::copysign(limit, q);
+  }
+  return int32_t(std::lround(q));
+}
+
+/* Member functions of Recorder */
+// nOfSlots frames can be waiting for the writer before push() waits
+bool Recorder::open(const string fileName, size_t n, float posQ, float velQ,
+                    int interval, int nOfSlots) {
+  close();
+
+  file.open(fileName, std::ios::binary);
+  if (!(file.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+    return false;
+  }
+
+  nOfParticles = n;
+  posQuantum = posQ;
+  velQuantum = velQ;
+  keyInterval = std::max(interval, 1);
+
+  file.write(recorderMagic, 4);
+  writeRaw(file, recorderVersion);
+  writeRaw(file, uint64_t(nOfParticles));
+  writeRaw(file, int32_t(keyInterval));
+  writeRaw(file, posQuantum);
+  writeRaw(file, velQuantum);
+
+  nOfFrames = 0;
+  nOfStalls = 0;
+  nOfBytes = uint64_t(file.tellp());
+
+  slots.resize(std::max(nOfSlots, 1));
+  for (size_t s = 0; s < slots.size(); s++) {
+    slots[s].data.resize(6 * nOfParticles);
+  }
+  head = 0;
+  tail = 0;
+  stopping = false;
+
+  prev.assign(6 * nOfParticles, 0);
+  offsets.clear();
+
+  writer = std::thread(&Recorder::writerLoop, this);
+
+  return true;
+}
+
+// copy the state into the next free slot and hand it to the writer
+void Recorder::push(const ParticleSoA &ps, unsigned step) {
+  if (!isOpen() || ps.size() != nOfParticles) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mtx);
+  if (head - tail == slots.size()) {
+    nOfStalls++;
+    notFull.wait(lock, [this] { return head - tail < slots.size(); });
+  }
+  Slot &slot = slots[head % slots.size()];
+  lock.unlock();
+
+  // the writer never touches the slot at head
+  const FloatArray *channels[6] = {&ps.x, &ps.y, &ps.z,
+                                   &ps.vx, &ps.vy, &ps.vz};
+  for (int c = 0; c < 6; c++) {
+    std::memcpy(slot.data.data() + c * nOfParticles, channels[c]->data(),
+                sizeof(float) * nOfParticles);
+  }
+  slot.step = step;
+
+  lock.lock();
+  head++;
+  lock.unlock();
+  notEmpty.notify_one();
+}
+
+// write the remaining frames and the frame index
+void Recorder::close() {
+  if (!isOpen()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  notEmpty.notify_one();
+  writer.join();
+
+  uint64_t indexOffset = uint64_t(file.tellp());
+  for (size_t f = 0; f < offsets.size(); f++) {
+    writeRaw(file, offsets[f]);
+  }
+  writeRaw(file, uint64_t(offsets.size()));
+  writeRaw(file, indexOffset);
+  file.write(indexMagic, 4);
+
+  nOfBytes = uint64_t(file.tellp());
+  file.close();
+}
+
+void Recorder::writerLoop() {
+  while (true) {
+    std::unique_lock<std::mutex> lock(mtx);
+    notEmpty.wait(lock, [this] { return head != tail || stopping; });
+    if (head == tail) {
+      return; // stopping, and nothing left
+    }
+    const Slot &slot = slots[tail % slots.size()];
+    lock.unlock();
+
+    bool key = (nOfFrames % keyInterval == 0);
+    encode(slot, key);
+
+    offsets.push_back(uint64_t(file.tellp()));
+    writeRaw(file, key ? keyFrame : deltaFrame);
+    writeRaw(file, uint32_t(slot.step));
+    writeRaw(file, uint32_t(buffer.size()));
+    file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+
+    nOfBytes += frameHeaderSize + buffer.size();
+    nOfFrames++;
+
+    lock.lock();
+    tail++;
+    lock.unlock();
+    notFull.notify_one();
+  }
+}
+
+// quantize the slot into buffer, as values or as deltas to prev
+void Recorder::encode(const Slot &slot, bool key) {
+  buffer.clear();
+
+  for (int c = 0; c < 6; c++) {
+    float quantum = (c < 3) ? posQuantum : velQuantum;
+    const float *src = slot.data.data() + c * nOfParticles;
+    int32_t *last = prev.data() + c * nOfParticles;
+
+    for (size_t i = 0; i < nOfParticles; i++) {
+      int32_t q = quantize(src[i], quantum);
+      putVarint(buffer, zigzag(key ? q : q - last[i]));
+      last[i] = q;
+    }
+  }
+}
+
+/* Member functions of Replayer */
+// reads the frame index, or rebuilds it by scanning the frames if the
+// recorder did not close the file
+bool Replayer::open(const string fileName) {
+  file.open(fileName, std::ios::binary);
+  if (!(file.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version;
+  uint64_t n;
+  int32_t interval;
+  file.read(magic, 4);
+  readRaw(file, version);
+  readRaw(file, n);
+  readRaw(file, interval);
+  readRaw(file, posQuantum);
+  if (!readRaw(file, velQuantum) || std::memcmp(magic, recorderMagic, 4) ||
+      version != recorderVersion) {
+    cout << "not a trajectory file : " << fileName << std::endl;
+    return false;
+  }
+
+  uint64_t firstFrame = uint64_t(file.tellg());
+  file.seekg(0, std::ios::end);
+  uint64_t fileSize = uint64_t(file.tellg());
+
+  // the index at the end of the file
+  offsets.clear();
+  if (fileSize >= firstFrame + trailerSize) {
+    uint64_t nOfFrames, indexOffset;
+    file.seekg(fileSize - trailerSize);
+    readRaw(file, nOfFrames);
+    readRaw(file, indexOffset);
+    file.read(magic, 4);
+
+    if (file && !std::memcmp(magic, indexMagic, 4) &&
+        indexOffset + nOfFrames * 8 + trailerSize == fileSize) {
+      offsets.resize(nOfFrames);
+      file.seekg(indexOffset);
+      for (uint64_t f = 0; f < nOfFrames; f++) {
+        readRaw(file, offsets[f]);
+      }
+    }
+  }
+
+  // no index, walk the frame headers
+  if (offsets.empty()) {
+    file.clear();
+    uint64_t offset = firstFrame;
+    while (offset + frameHeaderSize <= fileSize) {
+      uint32_t payloadSize;
+      file.seekg(offset + 1 + 4);
+      if (!readRaw(file, payloadSize) ||
+          offset + frameHeaderSize + payloadSize > fileSize) {
+        break; // truncated frame
+      }
+      offsets.push_back(offset);
+      offset += frameHeaderSize + payloadSize;
+    }
+  }
+
+  // every value takes at least one byte of a key frame, and the first
+  // frame is one, so n is bounded by its payload before anything is
+  // allocated for it
+  uint32_t keyPayload = 0;
+  file.clear();
+  if (!offsets.empty()) {
+    file.seekg(offsets[0] + 1 + 4);
+    readRaw(file, keyPayload);
+  }
+  if (interval < 1 || !(posQuantum > 0.f) || !(velQuantum > 0.f) ||
+      (!offsets.empty() && n > keyPayload / 6)) {
+    cout << "corrupt trajectory file : " << fileName << std::endl;
+    offsets.clear();
+    file.close();
+    return false;
+  }
+  nOfParticles = size_t(n);
+  keyInterval = interval;
+
+  file.clear();
+  values.assign(offsets.empty() ? 0 : 6 * nOfParticles, 0);
+  current = -1;
+
+  return true;
+}
+
+unsigned Replayer::getStep(unsigned frame) {
+  uint32_t step = 0;
+  if (frame < size()) {
+    file.seekg(offsets[frame] + 1);
+    readRaw(file, step);
+  }
+
+  return step;
+}
+
+// decode frame f on top of values, which must hold frame f - 1
+// unless f is a key frame
+bool Replayer::decodeNext(unsigned f) {
+  uint8_t type;
+  uint32_t step, payloadSize;
+  file.seekg(offsets[f]);
+  readRaw(file, type);
+  readRaw(file, step);
+  readRaw(file, payloadSize);
+
+  buffer.resize(payloadSize);
+  file.read(reinterpret_cast<char *>(buffer.data()), payloadSize);
+  if (!file || (type == deltaFrame && current != int(f) - 1)) {
+    file.clear();
+    return false;
+  }
+
+  // a corrupt payload leaves values half decoded, so nothing builds on it
+  const uint8_t *p = buffer.data();
+  const uint8_t *end = p + buffer.size();
+  for (size_t k = 0; k < values.size(); k++) {
+    uint32_t u;
+    if (!getVarint(p, end, u)) {
+      current = -1;
+      return false;
+    }
+    int32_t v = unzigzag(u);
+    values[k] = (type == keyFrame) ? v : values[k] + v;
+  }
+  current = int(f);
+
+  return true;
+}
+
+// Sequential playback decodes one frame per call. Seeking decodes from the
+// key frame before the target, at most keyInterval frames.
+bool Replayer::readFrame(unsigned frame, ParticleSoA &ps) {
+  if (frame >= size()) {
+    return false;
+  }
+
+  unsigned key = frame - frame % keyInterval;
+  unsigned first = key;
+  if (current >= int(key) && current <= int(frame)) {
+    first = unsigned(current) + 1;
+  }
+
+  for (unsigned f = first; f <= frame; f++) {
+    if (!decodeNext(f)) {
+      current = -1;
+      return false;
+    }
+  }
+
+  ps.resize(nOfParticles);
+  FloatArray *channels[6] = {&ps.x, &ps.y, &ps.z, &ps.vx, &ps.vy, &ps.vz};
+  for (int c = 0; c < 6; c++) {
+    float quantum = (c < 3) ? posQuantum : velQuantum;
+    const int32_t *src = values.data() + c * nOfParticles;
+    float *dst = channels[c]->data();
+    for (size_t i = 0; i < nOfParticles; i++) {
+      dst[i] = float(src[i]) * quantum;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,102 @@
+#include "recorder.h"
+
+// Reads trajectories written by Recorder.
+//
+// usage:
+//   replay a.sdfr             frame count and sizes
+//   replay a.sdfr k           write frame k to frame<k>.txt
+//   replay a.sdfr b.sdfr      compare two runs frame by frame
+
+void printInfo(Replayer &);
+void dumpFrame(Replayer &, unsigned);
+void compare(Replayer &, Replayer &);
+
+int main(int argc, char const *argv[]) {
+  if (argc < 2) {
+    std::cout << "usage: replay a.sdfr [frame | b.sdfr]" << '\n';
+    return 1;
+  }
+
+  Replayer a;
+  if (!a.open(argv[1])) {
+    return 1;
+  }
+
+  if (argc < 3) {
+    printInfo(a);
+    return 0;
+  }
+
+  // a number selects a frame, anything else is a second trajectory
+  string arg = argv[2];
+  if (arg.find_first_not_of("0123456789") == string::npos) {
+    dumpFrame(a, unsigned(atoi(argv[2])));
+    return 0;
+  }
+
+  Replayer b;
+  if (!b.open(arg)) {
+    return 1;
+  }
+  compare(a, b);
+
+  return 0;
+}
+
+void printInfo(Replayer &rp) {
+  std::cout << rp.size() << " frames of " << rp.nOfParticles
+            << " particles" << '\n';
+  std::cout << "key frame every " << rp.keyInterval << " frames, "
+            << "quantum " << rp.posQuantum << " (position), "
+            << rp.velQuantum << " (velocity)" << '\n';
+  if (rp.size() > 0) {
+    std::cout << "steps " << rp.getStep(0) << " to "
+              << rp.getStep(rp.size() - 1) << '\n';
+  }
+}
+
+void dumpFrame(Replayer &rp, unsigned frame) {
+  ParticleSoA ps;
+  if (!rp.readFrame(frame, ps)) {
+    std::cout << "no frame " << frame << '\n';
+    return;
+  }
+
+  string fileName = "frame" + to_string(frame) + ".txt";
+  writeParticles(ps, fileName);
+  std::cout << "step " << rp.getStep(frame) << " written to " << fileName
+            << '\n';
+}
+
+// largest position and velocity differences of every common frame
+void compare(Replayer &a, Replayer &b) {
+  if (a.nOfParticles != b.nOfParticles) {
+    std::cout << "particle counts differ: " << a.nOfParticles << " vs "
+              << b.nOfParticles << '\n';
+    return;
+  }
+
+  ParticleSoA pa, pb;
+  unsigned nOfFrames = std::min(a.size(), b.size());
+  float worst = 0.f;
+
+  for (unsigned f = 0; f < nOfFrames; f++) {
+    a.readFrame(f, pa);
+    b.readFrame(f, pb);
+
+    float dPos = 0.f, dVel = 0.f;
+    for (size_t i = 0; i < pa.size(); i++) {
+      dPos = std::max(dPos, length(pa.getPos(i) - pb.getPos(i)));
+      dVel = std::max(dVel, length(pa.getVelocity(i) - pb.getVelocity(i)));
+    }
+    worst = std::max(worst, dPos);
+
+    if (dPos > 0.f || dVel > 0.f) {
+      std::cout << "frame " << f << " (step " << a.getStep(f)
+                << "): position " << dPos << ", velocity " << dVel << '\n';
+    }
+  }
+
+  std::cout << nOfFrames << " frames compared, largest position difference "
+            << worst << '\n';
+}
@@ -0,0 +1,229 @@
+#include "rigidBody.h"
+#include "collider.h"
+
+/* Member functions of RigidShape */
+// The mass is spread evenly over the vertices, which is good enough for
+// the closed, evenly tessellated meshes in ./mesh.
+void RigidShape::create(const vector<vec3> &vertices, float totalMass) {
+  size_t n = vertices.size();
+  mass = totalMass;
+
+  center = vec3(0.f);
+  for (size_t i = 0; i < n; i++) {
+    center += vertices[i];
+  }
+  center /= float(n);
+
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  boundRadius = 0.f;
+
+  // inertia tensor of point masses
+  float mi = mass / float(n);
+  mat3 inertia(0.f);
+
+  for (size_t i = 0; i < n; i++) {
+    vec3 r = vertices[i] - center;
+    x[i] = r.x;
+    y[i] = r.y;
+    z[i] = r.z;
+    boundRadius = std::max(boundRadius, length(r));
+
+    inertia += mi * (dot(r, r) * mat3(1.f) - outerProduct(r, r));
+  }
+
+  invInertia = inverse(inertia);
+}
+
+// Every vertex of a body closer to the surface than margin is a contact.
+// A body whose center is farther from the surface, or from the box of the
+// field, than its bounding radius plus margin can not touch it, so only
+// its center is looked at.
+// Vertices are transformed and queried in blocks with the batched field
+// queries, and only the vertices in contact query the gradient.
+// Bodies are split into chunks that collect their contacts separately,
+// the chunks are then joined in body order.
+template <class Field>
+void generateContacts(const vector<RigidBody> &bodies,
+                      const vector<RigidShape> &shapes, const Field &field,
+                      float margin, ContactList &list, ThreadPool &pool) {
+  const size_t chunk = 64;
+  size_t nOfBodies = bodies.size();
+  size_t nOfChunks = (nOfBodies + chunk - 1) / chunk;
+
+  vector<vector<Contact>> found(nOfChunks);
+  list.start.assign(nOfBodies + 1, 0);
+
+  vec3 boxMin, boxMax;
+  field.getBounds(boxMin, boxMax);
+
+  pool.parallelFor(nOfBodies, chunk, [&](size_t begin, size_t end) {
+    const int blockSize = 256;
+
+    float wx[blockSize], wy[blockSize], wz[blockSize]; // world positions
+    float dist[blockSize];
+    int hit[blockSize];
+    float cx[blockSize], cy[blockSize], cz[blockSize];
+    float nx[blockSize], ny[blockSize], nz[blockSize];
+
+    vector<Contact> &out = found[begin / chunk];
+
+    for (size_t b = begin; b < end; b++) {
+      const RigidBody &body = bodies[b];
+      const RigidShape &shape = shapes[body.shape];
+      size_t before = out.size();
+
+      // bounding sphere early out
+      // a sphere outside the box of the field can not touch anything
+      float reach = shape.boundRadius + margin;
+      vec3 closest = clamp(body.pos, boxMin, boxMax);
+      if (length(closest - body.pos) > reach) {
+        continue;
+      }
+
+      // 9999 means the center is outside the field, which tells nothing
+      float d;
+      field.getDistances(&body.pos.x, &body.pos.y, &body.pos.z, &d, 1);
+      if (d < 9999.f && d > reach) {
+        continue;
+      }
+
+      mat3 R = mat3_cast(body.rot);
+      int nOfVtxs = int(shape.x.size());
+
+      for (int first = 0; first < nOfVtxs; first += blockSize) {
+        int count = std::min(blockSize, nOfVtxs - first);
+        const float *lx = shape.x.data() + first;
+        const float *ly = shape.y.data() + first;
+        const float *lz = shape.z.data() + first;
+
+        // to world space
+        for (int i = 0; i < count; i++) {
+          wx[i] = R[0][0] * lx[i] + R[1][0] * ly[i] + R[2][0] * lz[i];
+          wy[i] = R[0][1] * lx[i] + R[1][1] * ly[i] + R[2][1] * lz[i];
+          wz[i] = R[0][2] * lx[i] + R[1][2] * ly[i] + R[2][2] * lz[i];
+          wx[i] += body.pos.x;
+          wy[i] += body.pos.y;
+          wz[i] += body.pos.z;
+        }
+
+        field.getDistances(wx, wy, wz, dist, count);
+
+        int nOfHits = 0;
+        for (int i = 0; i < count; i++) {
+          hit[nOfHits] = i;
+          nOfHits += (dist[i] < margin);
+        }
+
+        for (int k = 0; k < nOfHits; k++) {
+          cx[k] = wx[hit[k]];
+          cy[k] = wy[hit[k]];
+          cz[k] = wz[hit[k]];
+        }
+        field.getGradients(cx, cy, cz, nx, ny, nz, nOfHits);
+
+        for (int k = 0; k < nOfHits; k++) {
+          Contact c;
+          c.point = vec3(cx[k], cy[k], cz[k]);
+          c.normal = -vec3(nx[k], ny[k], nz[k]); // gradients point inward
+          c.depth = dist[hit[k]];
+          out.push_back(c);
+        }
+      }
+
+      list.start[b + 1] = unsigned(out.size() - before);
+    }
+  });
+
+  // counts to offsets
+  for (size_t b = 0; b < nOfBodies; b++) {
+    list.start[b + 1] += list.start[b];
+  }
+
+  list.contacts.resize(list.start[nOfBodies]);
+  pool.parallelFor(nOfChunks, 1, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      std::copy(found[c].begin(), found[c].end(),
+                list.contacts.begin() + list.start[c * chunk]);
+    }
+  });
+}
+
+// Semi-implicit Euler with impulses against the static field.
+// The impulse of each approaching contact is divided by the number of
+// contacts of the body, so a body resting on many vertices is not
+// kicked harder than one touching with a single vertex. Penetration is
+// resolved by moving the body out along the normal of its deepest contact.
+// Every body only reads its own contacts, so bodies are independent.
+void stepRigidBodies(vector<RigidBody> &bodies,
+                     const vector<RigidShape> &shapes,
+                     const ContactList &list, const RigidParams &params,
+                     ThreadPool &pool) {
+  const size_t chunk = 64;
+  float dt = params.dt;
+
+  pool.parallelFor(bodies.size(), chunk, [&](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; b++) {
+      RigidBody &body = bodies[b];
+      const RigidShape &shape = shapes[body.shape];
+
+      body.v += dt * params.g;
+
+      mat3 R = mat3_cast(body.rot);
+      mat3 invI = R * shape.invInertia * transpose(R);
+      float invMass = 1.f / shape.mass;
+
+      unsigned first = list.start[b];
+      unsigned last = list.start[b + 1];
+      float share = 1.f / float(std::max(last - first, 1u));
+
+      float deepest = 0.f;
+      vec3 deepestNormal(0.f);
+
+      for (unsigned k = first; k < last; k++) {
+        const Contact &c = list.contacts[k];
+
+        if (c.depth < deepest) {
+          deepest = c.depth;
+          deepestNormal = c.normal;
+        }
+
+        // velocity of the contact point
+        vec3 r = c.point - body.pos;
+        vec3 vp = body.v + cross(body.w, r);
+        float vn = dot(vp, c.normal);
+        if (vn >= 0.f) {
+          continue;
+        }
+
+        // inverse effective mass along the normal
+        vec3 rn = cross(r, c.normal);
+        float effMass = invMass + dot(rn, invI * rn);
+
+        vec3 vt = vp - vn * c.normal;
+        vec3 impulse = -(1.f + params.restitution) * vn * c.normal;
+        impulse -= params.friction * vt;
+        impulse *= share / effMass;
+
+        body.v += invMass * impulse;
+        body.w += invI * cross(r, impulse);
+      }
+
+      body.pos -= deepest * deepestNormal;
+
+      // integrate
+      body.pos += dt * body.v;
+      quat spin(0.f, body.w.x, body.w.y, body.w.z);
+      body.rot = normalize(body.rot + (0.5f * dt) * spin * body.rot);
+    }
+  });
+}
+
+template void generateContacts(const vector<RigidBody> &,
+                               const vector<RigidShape> &, const Grid &,
+                               float, ContactList &, ThreadPool &);
+template void generateContacts(const vector<RigidBody> &,
+                               const vector<RigidShape> &,
+                               const ColliderScene &, float, ContactList &,
+                               ThreadPool &);
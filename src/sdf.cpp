@@ -1,4 +1,9 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include "binaryIo.h"
 #include "sdf.h"
+#include "threadPool.h"
 
 // Given A, B, Q
 // Project Q on AB at P
@@ -202,7 +207,12 @@ float distPoint2Triangle(vec3 a, vec3 b, vec3 c, vec3 n, vec3 p) {
 
   // std::cout << "dist = " << dist << '\n';
 
-  // sign
+  return dist * sideSign(a, n, p);
+}
+
+// Sign of the distance from P to the plane through A with normal N
+// +1 in front of the plane, -1 behind it
+float sideSign(vec3 a, vec3 n, vec3 p) {
   // vec3 ap = p - a;
   float temp = dot(p - a, n);
   // if P is on the same plane of triangle
@@ -225,7 +235,75 @@ float distPoint2Triangle(vec3 a, vec3 b, vec3 c, vec3 n, vec3 p) {
 
   // std::cout << "sign = " << sign << '\n';
 
-  return dist * sign;
+  return sign;
+}
+
+// Closest point to P on the triangle ABC
+// bary receives its barycentric coordinates (u, v, w), point = uA + vB + wC
+// Tests the Voronoi regions of the vertices, then of the edges, then the
+// inside [Ericson 2005, 5.1.5]. Unlike distPoint2Triangle, it does not
+// need the normal and stays exact for points in the plane of ABC.
+vec3 closestPoint2Triangle(vec3 a, vec3 b, vec3 c, vec3 p, vec3 &bary) {
+  vec3 ab = b - a;
+  vec3 ac = c - a;
+
+  // region A
+  vec3 ap = p - a;
+  float d1 = dot(ab, ap);
+  float d2 = dot(ac, ap);
+  if (d1 <= 0.f && d2 <= 0.f) {
+    bary = vec3(1.f, 0.f, 0.f);
+    return a;
+  }
+
+  // region B
+  vec3 bp = p - b;
+  float d3 = dot(ab, bp);
+  float d4 = dot(ac, bp);
+  if (d3 >= 0.f && d4 <= d3) {
+    bary = vec3(0.f, 1.f, 0.f);
+    return b;
+  }
+
+  // region AB
+  float vc = d1 * d4 - d3 * d2;
+  if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+    float v = d1 / (d1 - d3);
+    bary = vec3(1.f - v, v, 0.f);
+    return a + v * ab;
+  }
+
+  // region C
+  vec3 cp = p - c;
+  float d5 = dot(ab, cp);
+  float d6 = dot(ac, cp);
+  if (d6 >= 0.f && d5 <= d6) {
+    bary = vec3(0.f, 0.f, 1.f);
+    return c;
+  }
+
+  // region CA
+  float vb = d5 * d2 - d1 * d6;
+  if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+    float w = d2 / (d2 - d6);
+    bary = vec3(1.f - w, 0.f, w);
+    return a + w * ac;
+  }
+
+  // region BC
+  float va = d3 * d6 - d5 * d4;
+  if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f) {
+    float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    bary = vec3(0.f, 1.f - w, w);
+    return b + w * (c - b);
+  }
+
+  // inside
+  float denom = 1.f / (va + vb + vc);
+  float v = vb * denom;
+  float w = vc * denom;
+  bary = vec3(1.f - v - w, v, w);
+  return a + v * ab + w * ac;
 }
 
 // using world space position to calculate node hash
@@ -264,7 +342,6 @@ float Grid::getDistance(vec3 p) {
   // restriction
   ivec3 idx = floor(p / cellSize);
 
-  // note that grid origin is set to world origin (0, 0, 0)
   if (idx.x < 0 || idx.x > nOfCells.x - 1) {
     return 9999.f;
   } else if (idx.y < 0 || idx.y > nOfCells.y - 1) {
@@ -277,6 +354,23 @@ float Grid::getDistance(vec3 p) {
   }
 }
 
+// closest face recorded for the cell getDistance(p) reads
+// A near-surface query can refine it with a single triangle test, and
+// per-face attributes can be looked up without searching the mesh.
+int Grid::getFaceId(vec3 p) const {
+  if (faceIds.empty()) {
+    return -1;
+  }
+
+  ivec3 idx = floor((p - origin) / cellSize);
+  if (idx.x < 0 || idx.x > nOfCells.x - 1 || idx.y < 0 ||
+      idx.y > nOfCells.y - 1 || idx.z < 0 || idx.z > nOfCells.z - 1) {
+    return -1;
+  }
+
+  return faceIds[idx.x + nOfCells.x * (idx.y + nOfCells.y * idx.z)];
+}
+
 // retrieve gradient of a point p
 vec3 Grid::getGradient2(vec3 p) {
   vec3 grad;
@@ -319,10 +413,8 @@ vec3 Grid::getGradient2(vec3 p) {
   return glm::normalize(-grad);
 }
 
+// central differences of getDistance(vec3), which handles the origin
 vec3 Grid::getGradient(vec3 p) {
-  // transform to the reference frame of the grid
-  p -= origin;
-
   float gx = getDistance(vec3(p.x + cellSize, p.y, p.z)) -
              getDistance(vec3(p.x - cellSize, p.y, p.z));
 
@@ -334,3 +426,563 @@ vec3 Grid::getGradient(vec3 p) {
 
   return normalize(-vec3(gx, gy, gz));
 }
+
+/* Batched queries */
+// Same results as getDistance(vec3) and getGradient(vec3), but positions
+// come as separate x, y, z arrays so that the index arithmetic of a whole
+// batch can be vectorized. Only the final lookup into cells is a gather.
+
+// floor() for the index computation, written without a library call
+// so that the compiler can vectorize it
+static inline int floorToInt(float f) {
+  int i = int(f);
+  return i - (f < float(i));
+}
+
+void Grid::getDistances(const float *px, const float *py, const float *pz,
+                        float *out, int n) const {
+  int nxy = nOfCells.x * nOfCells.y;
+  const Cell *data = cells.data();
+
+  for (int i = 0; i < n; i++) {
+    int ix = floorToInt((px[i] - origin.x) / cellSize);
+    int iy = floorToInt((py[i] - origin.y) / cellSize);
+    int iz = floorToInt((pz[i] - origin.z) / cellSize);
+
+    bool inside = (ix >= 0) & (ix < nOfCells.x) & (iy >= 0) &
+                  (iy < nOfCells.y) & (iz >= 0) & (iz < nOfCells.z);
+    int hash = inside ? (ix + iy * nOfCells.x + iz * nxy) : 0;
+
+    out[i] = inside ? data[hash].sd : 9999.f;
+  }
+}
+
+void Grid::getGradients(const float *px, const float *py, const float *pz,
+                        float *gx, float *gy, float *gz, int n) const {
+  // central differences in blocks, reusing the batched distance query
+  const int blockSize = 64;
+  float sx[blockSize], sy[blockSize], sz[blockSize];
+  float dPlus[blockSize], dMinus[blockSize];
+
+  for (int begin = 0; begin < n; begin += blockSize) {
+    int count = std::min(blockSize, n - begin);
+    const float *bx = px + begin;
+    const float *by = py + begin;
+    const float *bz = pz + begin;
+
+    for (int axis = 0; axis < 3; axis++) {
+      float *g = (axis == 0) ? gx : ((axis == 1) ? gy : gz);
+      float ox = (axis == 0) ? cellSize : 0.f;
+      float oy = (axis == 1) ? cellSize : 0.f;
+      float oz = (axis == 2) ? cellSize : 0.f;
+
+      for (int i = 0; i < count; i++) {
+        sx[i] = bx[i] + ox;
+        sy[i] = by[i] + oy;
+        sz[i] = bz[i] + oz;
+      }
+      getDistances(sx, sy, sz, dPlus, count);
+
+      for (int i = 0; i < count; i++) {
+        sx[i] = bx[i] - ox;
+        sy[i] = by[i] - oy;
+        sz[i] = bz[i] - oz;
+      }
+      getDistances(sx, sy, sz, dMinus, count);
+
+      for (int i = 0; i < count; i++) {
+        g[begin + i] = dMinus[i] - dPlus[i]; // -grad
+      }
+    }
+
+    // normalize
+    for (int i = begin; i < begin + count; i++) {
+      float len = std::sqrt(gx[i] * gx[i] + gy[i] * gy[i] + gz[i] * gz[i]);
+      float inv = 1.f / len;
+      gx[i] *= inv;
+      gy[i] *= inv;
+      gz[i] *= inv;
+    }
+  }
+}
+
+void Grid::getBounds(vec3 &boxMin, vec3 &boxMax) const {
+  boxMin = origin;
+  boxMax = origin + vec3(nOfCells) * cellSize;
+}
+
+/* Continuous collision detection */
+// Sphere tracing [Hart, 1996] along the segment p0 -> p1.
+// The distance value is a safe step size: nothing can be hit within it.
+// Returns true if the segment comes closer than radius to the surface
+// while moving towards it; toi is the travelled fraction of the segment at
+// that point, and normal the outward surface normal there.
+bool Grid::traceSegment(vec3 p0, vec3 p1, float radius, float &toi,
+                        vec3 &normal) const {
+  vec3 seg = p1 - p0;
+
+  // clip the segment to the grid box, there is nothing to hit outside
+  // (and getDistance returns 9999 there, which is not a safe step)
+  vec3 boxMin, boxMax;
+  getBounds(boxMin, boxMax);
+  float tMin = 0.f, tMax = 1.f;
+
+  for (int a = 0; a < 3; a++) {
+    if (glm::abs(seg[a]) < 1e-12f) {
+      if (p0[a] < boxMin[a] || p0[a] >= boxMax[a]) {
+        return false;
+      }
+    } else {
+      float t1 = (boxMin[a] - p0[a]) / seg[a];
+      float t2 = (boxMax[a] - p0[a]) / seg[a];
+      tMin = std::max(tMin, std::min(t1, t2));
+      tMax = std::min(tMax, std::max(t1, t2));
+    }
+  }
+
+  if (tMin > tMax) {
+    return false;
+  }
+
+  // cells are looked up without interpolation, so a sample may
+  // overestimate the true distance by up to a cell diagonal
+  float slack = cellSize * 1.7320508f;
+  float minStep = 0.5f * cellSize;
+
+  float len = length(seg);
+  float t = tMin * len;
+  float tEnd = tMax * len;
+  float tSafe = t; // last sample known to be clear of the surface
+  vec3 dir = (len > 0.f) ? seg / len : vec3(0.f);
+
+  while (true) {
+    vec3 p = p0 + dir * t;
+
+    float d;
+    getDistances(&p.x, &p.y, &p.z, &d, 1);
+
+    if (d < radius) {
+      // only motion into the surface is a hit, so that a point already
+      // within radius can still move away from it
+      vec3 n;
+      getGradients(&p.x, &p.y, &p.z, &n.x, &n.y, &n.z, 1);
+      if (dot(seg, n) <= 0.f) { // n points into the object
+        if (t >= tEnd) {
+          return false;
+        }
+        tSafe = t;
+        t = std::min(t + minStep, tEnd);
+        continue;
+      }
+
+      // stop at the last safe sample rather than inside the surface
+      vec3 contact = p0 + dir * tSafe;
+      toi = (len > 0.f) ? tSafe / len : 0.f;
+      getGradients(&contact.x, &contact.y, &contact.z, &normal.x, &normal.y,
+                   &normal.z, 1);
+      normal = -normal; // the gradient queries point into the object
+      return true;
+    }
+
+    if (t >= tEnd) {
+      return false;
+    }
+
+    tSafe = t;
+    t = std::min(t + std::max(d - radius - slack, minStep), tEnd);
+  }
+}
+
+// split [0, n) into contiguous ranges and run them on the shared pool
+// func(begin, end) must only write data owned by its range
+void parallelFor(int n, const function<void(int, int)> &func) {
+  ThreadPool &pool = getThreadPool();
+
+  // a few chunks per thread to balance uneven work
+  size_t chunk = std::max(1, n / (pool.size() * 4));
+  pool.parallelFor(n, chunk, [&](size_t begin, size_t end) {
+    func(int(begin), int(end));
+  });
+}
+
+/* Euclidean distance transform */
+// [Felzenszwalb and Huttenlocher, 2012] "Distance transforms of sampled
+// functions". The squared distance transform is separable, so a 3D field is
+// computed by three passes of the 1D transform along x, y and z.
+// Cost is linear in the number of cells and independent of the mesh.
+
+const float EDT_INF = 1e20f;
+
+// x-coordinate where the parabolas rooted at samples p and q intersect
+static inline float parabolaIntersect(const float *f, int p, int q) {
+  float fp = f[p] + float(p * p);
+  float fq = f[q] + float(q * q);
+
+  return (fq - fp) / float(2 * (q - p));
+}
+
+// 1D squared distance transform of n samples f
+// (lower envelope of the parabolas rooted at each finite sample)
+// v and z are scratch buffers of size n and n + 1
+static void edt1d(const float *f, float *d, int n, int *v, float *z) {
+  // samples at infinity never contribute to the envelope
+  int first = 0;
+  while (first < n && f[first] >= EDT_INF) {
+    first++;
+  }
+
+  if (first == n) {
+    for (int q = 0; q < n; q++) {
+      d[q] = EDT_INF;
+    }
+    return;
+  }
+
+  int k = 0;
+  v[0] = first;
+  z[0] = -EDT_INF;
+  z[1] = EDT_INF;
+
+  for (int q = first + 1; q < n; q++) {
+    if (f[q] >= EDT_INF) {
+      continue;
+    }
+
+    // intersection of the parabola at q and the rightmost one in the envelope
+    // z[0] is -inf, so k never drops below 0
+    int p = v[k];
+    float s = parabolaIntersect(f, p, q);
+    while (s <= z[k]) {
+      k--;
+      p = v[k];
+      s = parabolaIntersect(f, p, q);
+    }
+
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = EDT_INF;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < float(q)) {
+      k++;
+    }
+    float dq = float(q - v[k]);
+    d[q] = dq * dq + f[v[k]];
+  }
+}
+
+// in-place squared distance transform of a field stored in hash order
+// (x first, then y, then z), distances are measured in cells
+static void edt3d(vector<float> &field, ivec3 n) {
+  int maxN = std::max(n.x, std::max(n.y, n.z));
+  int sliceSize = n.x * n.y;
+
+  // one pass along a single axis
+  // each line is gathered into a buffer, transformed, and scattered back
+  auto pass = [&](int nOfLines, int length, int stride,
+                  const function<int(int)> &lineStart) {
+    parallelFor(nOfLines, [&](int begin, int end) {
+      vector<float> f(maxN), d(maxN), z(maxN + 1);
+      vector<int> v(maxN);
+
+      for (int line = begin; line < end; line++) {
+        int start = lineStart(line);
+
+        for (int q = 0; q < length; q++) {
+          f[q] = field[start + q * stride];
+        }
+
+        edt1d(f.data(), d.data(), length, v.data(), z.data());
+
+        for (int q = 0; q < length; q++) {
+          field[start + q * stride] = d[q];
+        }
+      }
+    });
+  };
+
+  // along x: one row per (y, z)
+  pass(n.y * n.z, n.x, 1, [&](int line) { return line * n.x; });
+
+  // along y: one column per (x, z)
+  pass(n.x * n.z, n.y, n.x, [&](int line) {
+    int ix = line % n.x;
+    int iz = line / n.x;
+    return ix + iz * sliceSize;
+  });
+
+  // along z: one column per (x, y)
+  pass(n.x * n.y, n.z, sliceSize, [&](int line) { return line; });
+}
+
+// Build a signed distance field from a voxel occupancy grid
+// occupied[hash] != 0 marks a cell inside the object,
+// where hash follows the layout of Grid::cells.
+// gd.nOfCells, gd.cellSize and gd.origin must be set in advance.
+// The surface is assumed to lie half a cell away from the boundary cells,
+// so the result is an approximation within cellSize of the exact field.
+void distanceTransform(Grid &gd, const vector<char> &occupied) {
+  ivec3 n = gd.nOfCells;
+  int nOfCells = n.x * n.y * n.z;
+
+  // distance to the nearest inside cell, and to the nearest outside cell
+  vector<float> dOut(nOfCells), dIn(nOfCells);
+  for (int i = 0; i < nOfCells; i++) {
+    dOut[i] = occupied[i] ? 0.f : EDT_INF;
+    dIn[i] = occupied[i] ? EDT_INF : 0.f;
+  }
+
+  edt3d(dOut, n);
+  edt3d(dIn, n);
+
+  // cells are created here if the grid is empty
+  if (gd.cells.size() != size_t(nOfCells)) {
+    gd.cells.resize(nOfCells);
+
+    for (int iz = 0; iz < n.z; iz++) {
+      for (int iy = 0; iy < n.y; iy++) {
+        for (int ix = 0; ix < n.x; ix++) {
+          Cell &cell = gd.cells[ix + iy * n.x + iz * n.x * n.y];
+          cell.idx = ivec3(ix, iy, iz);
+          cell.pos = vec3(ix, iy, iz) * gd.cellSize + gd.origin;
+        }
+      }
+    }
+  }
+
+  // combine both sides into a signed field
+  float halfCell = 0.5f * gd.cellSize;
+  parallelFor(nOfCells, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      float sd;
+      if (occupied[i]) {
+        sd = -(std::sqrt(dIn[i]) * gd.cellSize - halfCell);
+      } else {
+        sd = std::sqrt(dOut[i]) * gd.cellSize - halfCell;
+      }
+
+      // keep the same "far away" value as the rest of sdf3d
+      gd.cells[i].sd = glm::clamp(sd, -9999.f, 9999.f);
+    }
+  });
+}
+
+// format: x, y, z, i, j, k, dist[, face] per line
+// face is written only if the grid has the face id channel
+void writeSdf(Grid &gd, const string fileName) {
+  ofstream output(fileName);
+  bool hasFaces = (gd.faceIds.size() == gd.cells.size());
+
+  for (size_t i = 0; i < gd.cells.size(); i++) {
+    Cell &cell = gd.cells[i];
+
+    output << cell.pos.x;
+    output << " ";
+    output << cell.pos.y;
+    output << " ";
+    output << cell.pos.z;
+    output << " ";
+    output << cell.idx.x;
+    output << " ";
+    output << cell.idx.y;
+    output << " ";
+    output << cell.idx.z;
+    output << " ";
+    output << cell.sd;
+    if (hasFaces) {
+      output << " ";
+      output << gd.faceIds[i];
+    }
+    output << '\n';
+  }
+
+  output.close();
+}
+
+// the face column is optional, files without it leave faceIds empty
+void readSdf(Grid &gd, const string fileName) {
+  ifstream fin;
+  fin.open(fileName.c_str());
+
+  if (!(fin.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+  }
+
+  // read file
+  while (fin.peek() != EOF) {
+    Cell cell;
+
+    fin >> cell.pos.x;
+    fin >> cell.pos.y;
+    fin >> cell.pos.z;
+
+    fin >> cell.idx.x;
+    fin >> cell.idx.y;
+    fin >> cell.idx.z;
+
+    fin >> cell.sd;
+    if (!fin) {
+      break; // a partial line, e.g. trailing blanks
+    }
+
+    // face id, if there is something left on this line
+    while (fin.peek() == ' ' || fin.peek() == '\t' || fin.peek() == '\r') {
+      fin.ignore(1);
+    }
+    if (fin.peek() != '\n' && fin.peek() != EOF) {
+      int face;
+      fin >> face;
+      gd.faceIds.resize(gd.cells.size(), -1);
+      gd.faceIds.push_back(face);
+    }
+
+    // ignore '\n'
+    // otherwise, the last empty line will be read
+    fin.ignore(1);
+
+    gd.cells.push_back(cell);
+  } // end read file
+
+  // std::cout << "cells.size()" << gd.cells.size() << '\n';
+
+  fin.close();
+}
+
+// SDF generated by SDFGen
+// from https://github.com/christopherbatty
+// note that the <padding> parameter translates the mesh
+// with (dx * padding)
+void readSdfBatty(Grid &gd, const string fileName) {
+  ifstream fin;
+  fin.open(fileName.c_str());
+
+  if (!(fin.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+  }
+
+  // # of cells
+  fin >> gd.nOfCells.x;
+  fin >> gd.nOfCells.y;
+  fin >> gd.nOfCells.z;
+
+  // origin
+  fin >> gd.origin.x;
+  fin >> gd.origin.y;
+  fin >> gd.origin.z;
+  // assume the origin is always (0, 0, 0)
+  gd.origin = vec3(0);
+
+  // cell size
+  fin >> gd.cellSize;
+
+  // read sdf
+  for (size_t k = 0; k < gd.nOfCells.z; k++) {
+    for (size_t j = 0; j < gd.nOfCells.y; j++) {
+      for (size_t i = 0; i < gd.nOfCells.x; i++) {
+        Cell cell;
+
+        cell.pos = vec3(i * gd.cellSize, j * gd.cellSize, k * gd.cellSize);
+        cell.pos += gd.origin;
+
+        // if padding is 1
+        // cell.pos += vec3(gd.cellSize * 1.f);
+        // or translate the mesh instead
+
+        cell.idx = ivec3(i, j, k);
+
+        fin >> cell.sd;
+        if (!fin) {
+          // fewer cells than nOfCells tells the caller the file is short
+          cout << "truncated file : " << fileName << std::endl;
+          fin.close();
+          return;
+        }
+
+        gd.cells.push_back(cell);
+      }
+    }
+  }
+
+  fin.close();
+}
+
+/* Shard files */
+// header : magic "SDFH", version, meshHash, nOfCells, origin, cellSize,
+//          lo, hi
+// cells  : sd as floats, then faceIds as int32, both x fastest
+// Multi-byte values are stored in the byte order of the machine.
+static const char shardMagic[4] = {'S', 'D', 'F', 'H'};
+static const uint32_t shardVersion = 2;
+
+void writeShard(const Shard &shard, const string fileName) {
+  ofstream output(fileName, std::ios::binary);
+
+  if (!(output.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+    return;
+  }
+
+  output.write(shardMagic, 4);
+  writeRaw(output, shardVersion);
+  writeRaw(output, shard.meshHash);
+  writeRaw(output, shard.nOfCells);
+  writeRaw(output, shard.origin);
+  writeRaw(output, shard.cellSize);
+  writeRaw(output, shard.lo);
+  writeRaw(output, shard.hi);
+
+  writeArray(output, shard.sd);
+  writeArray(output, shard.faceIds);
+
+  output.close();
+}
+
+bool readShard(Shard &shard, const string fileName) {
+  ifstream fin(fileName, std::ios::binary);
+
+  if (!(fin.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version;
+  fin.read(magic, 4);
+  readRaw(fin, version);
+  readRaw(fin, shard.meshHash);
+  readRaw(fin, shard.nOfCells);
+  readRaw(fin, shard.origin);
+  readRaw(fin, shard.cellSize);
+  readRaw(fin, shard.lo);
+  if (!readRaw(fin, shard.hi) || std::memcmp(magic, shardMagic, 4) ||
+      version != shardVersion) {
+    cout << "not a shard file : " << fileName << std::endl;
+    return false;
+  }
+
+  // before anything is allocated from the header
+  ivec3 lo = shard.lo, hi = shard.hi, nOfCells = shard.nOfCells;
+  if (!(shard.cellSize > 0.f) ||
+      std::min({nOfCells.x, nOfCells.y, nOfCells.z}) < 1 ||
+      std::min({lo.x, lo.y, lo.z}) < 0 || hi.x > nOfCells.x ||
+      hi.y > nOfCells.y || hi.z > nOfCells.z || lo.x > hi.x ||
+      lo.y > hi.y || lo.z > hi.z) {
+    cout << "corrupt shard file : " << fileName << std::endl;
+    return false;
+  }
+
+  ivec3 size = hi - lo;
+  size_t n = size_t(size.x) * size.y * size.z;
+  shard.sd.resize(n);
+  shard.faceIds.resize(n);
+
+  if (!readArray(fin, shard.sd) || !readArray(fin, shard.faceIds)) {
+    cout << "truncated shard file : " << fileName << std::endl;
+    return false;
+  }
+
+  return true;
+}
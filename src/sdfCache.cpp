@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sdfCache.h"
+
+namespace fs = std::filesystem;
+
+/* Entry format */
+// header : magic "SDFC", version, origin, cellSize, nOfCells,
+//          number of cells, 1 if faceIds follow
+// cells  : Cell structs as they are in memory, then faceIds as int32
+// Multi-byte values are stored in the byte order of the machine.
+static const char cacheMagic[4] = {'S', 'D', 'F', 'C'};
+static const uint32_t cacheVersion = 1;
+
+// part of the key of readSdfCached, bump whenever a reader passed to it
+// (readSdf, readSdfBatty, ...) changes the grid it produces
+static const uint32_t readerVersion = 2;
+
+// temporary files are named entry + tmpMarker + host + "." + pid
+static const string tmpMarker = ".tmp.";
+// a temporary file of another host is only removed after this long
+static const std::chrono::hours tmpMaxAge(24);
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  vec3 origin;
+  float cellSize;
+  ivec3 nOfCells;
+  uint32_t hasFaces;
+  uint64_t nOfCells1d;
+} CacheHeader;
+
+static string getHost() {
+  char host[256] = "";
+  gethostname(host, sizeof(host) - 1);
+  return host;
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  uint64_t h = seed;
+
+  for (size_t i = 0; i < size; i++) {
+    h ^= bytes[i];
+    h *= 1099511628211u;
+  }
+
+  return h;
+}
+
+uint64_t hashFile(const string fileName, uint64_t seed) {
+  ifstream fin(fileName, std::ios::binary);
+
+  if (!(fin.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+    return seed;
+  }
+
+  vector<char> buffer(1 << 20);
+  uint64_t h = seed;
+  while (fin) {
+    fin.read(buffer.data(), buffer.size());
+    h = hashBytes(buffer.data(), size_t(fin.gcount()), h);
+  }
+
+  return h;
+}
+
+string SdfCache::calPath(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.sdfc", (unsigned long long)key);
+  return dir + "/" + name;
+}
+
+bool SdfCache::load(uint64_t key, Grid &gd) {
+  string path = calPath(key);
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = size_t(st.st_size);
+  void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+
+  const char *bytes = static_cast<const char *>(mapped);
+  CacheHeader header;
+  std::memcpy(&header, bytes, sizeof(header));
+
+  size_t n = size_t(header.nOfCells1d);
+  size_t expected = sizeof(header) + n * sizeof(Cell) +
+                    (header.hasFaces ? n * sizeof(int) : 0);
+
+  bool valid = !std::memcmp(header.magic, cacheMagic, 4) &&
+               header.version == cacheVersion && size == expected;
+
+  if (valid) {
+    gd.origin = header.origin;
+    gd.cellSize = header.cellSize;
+    gd.nOfCells = header.nOfCells;
+
+    const Cell *cells = reinterpret_cast<const Cell *>(bytes + sizeof(header));
+    gd.cells.assign(cells, cells + n);
+
+    gd.faceIds.clear();
+    if (header.hasFaces) {
+      const int *faceIds = reinterpret_cast<const int *>(cells + n);
+      gd.faceIds.assign(faceIds, faceIds + n);
+    }
+  }
+
+  munmap(mapped, size);
+
+  if (!valid) {
+    cout << "invalid cache entry : " << path << std::endl;
+    return false;
+  }
+
+  // used just now, so the last to be evicted
+  std::error_code ec;
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+  return true;
+}
+
+void SdfCache::store(uint64_t key, const Grid &gd) {
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+
+  string path = calPath(key);
+
+  // every process writes its own temporary file, the rename is atomic
+  string tmpPath = path + tmpMarker + getHost() + "." + to_string(getpid());
+  ofstream output(tmpPath, std::ios::binary);
+
+  if (!(output.good())) {
+    cout << "failed to open file : " << tmpPath << std::endl;
+    return;
+  }
+
+  bool hasFaces = (gd.faceIds.size() == gd.cells.size());
+
+  CacheHeader header;
+  std::memcpy(header.magic, cacheMagic, 4);
+  header.version = cacheVersion;
+  header.origin = gd.origin;
+  header.cellSize = gd.cellSize;
+  header.nOfCells = gd.nOfCells;
+  header.hasFaces = hasFaces;
+  header.nOfCells1d = gd.cells.size();
+
+  output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  output.write(reinterpret_cast<const char *>(gd.cells.data()),
+               gd.cells.size() * sizeof(Cell));
+  if (hasFaces) {
+    output.write(reinterpret_cast<const char *>(gd.faceIds.data()),
+                 gd.faceIds.size() * sizeof(int));
+  }
+  output.close();
+
+  if (!output) {
+    cout << "failed to write file : " << tmpPath << std::endl;
+    fs::remove(tmpPath, ec);
+    return;
+  }
+
+  fs::rename(tmpPath, path, ec);
+  if (ec) {
+    cout << "failed to rename file : " << tmpPath << std::endl;
+    fs::remove(tmpPath, ec);
+    return;
+  }
+
+  evict(path);
+}
+
+// Oldest first, until the entries fit into the capacity. The entry just
+// stored is kept even if it alone is larger. Readers that mapped an entry
+// keep their mapping after it is removed.
+// Temporary files of processes that died before the rename are removed
+// on the way, they would never be renamed or evicted otherwise. Only
+// processes of this host can be checked, the cache directory may be
+// shared, so those of other hosts are removed once they are old.
+void SdfCache::evict(const string &keep) {
+  typedef struct {
+    fs::file_time_type time;
+    uintmax_t size;
+    fs::path path;
+  } Entry;
+
+  vector<Entry> entries;
+  uintmax_t total = 0;
+  std::error_code ec;
+
+  const string tmpOfEntry = ".sdfc" + tmpMarker;
+  const string host = getHost();
+
+  for (const fs::directory_entry &e : fs::directory_iterator(dir, ec)) {
+    string name = e.path().filename().string();
+    size_t tmp = name.find(tmpOfEntry);
+    if (tmp != string::npos) {
+      // host, then pid after the last dot
+      string writer = name.substr(tmp + tmpOfEntry.size());
+      size_t dot = writer.rfind('.');
+      bool dead = false;
+      if (dot != string::npos && writer.substr(0, dot) == host) {
+        pid_t pid = pid_t(atol(writer.c_str() + dot + 1));
+        dead = (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH);
+      } else {
+        fs::file_time_type time = e.last_write_time(ec);
+        dead = !ec && fs::file_time_type::clock::now() - time > tmpMaxAge;
+      }
+
+      if (dead) {
+        fs::remove(e.path(), ec);
+      }
+      continue;
+    }
+
+    if (e.path().extension() != ".sdfc") {
+      continue;
+    }
+
+    Entry entry = {e.last_write_time(ec), e.file_size(ec), e.path()};
+    if (!ec) {
+      entries.push_back(entry);
+      total += entry.size;
+    }
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.time < b.time; });
+
+  for (size_t i = 0; i < entries.size() && total > capacity; i++) {
+    if (entries[i].path == fs::path(keep)) {
+      continue;
+    }
+
+    // another process may have removed it already
+    if (fs::remove(entries[i].path, ec)) {
+      total -= entries[i].size;
+    }
+  }
+}
+
+// The key is the hash of the file, of the tag naming the reader and of
+// readerVersion, so the same file read in two ways makes two entries.
+// A grid whose cells do not fill nOfCells is the reader failing on the
+// file, and is not stored.
+void readSdfCached(Grid &gd, const string fileName,
+                   void (*reader)(Grid &, const string), const string tag,
+                   SdfCache &cache) {
+  // nothing to key on, the reader reports the missing file
+  if (!fs::exists(fileName)) {
+    reader(gd, fileName);
+    return;
+  }
+
+  uint64_t key = hashBytes(tag.data(), tag.size());
+  key = hashFile(fileName, hashValue(readerVersion, key));
+
+  if (cache.load(key, gd)) {
+    return;
+  }
+
+  reader(gd, fileName);
+
+  ivec3 n = gd.nOfCells;
+  if (gd.cells.empty() || std::min({n.x, n.y, n.z}) < 1 ||
+      gd.cells.size() != size_t(n.x) * n.y * n.z) {
+    return;
+  }
+  cache.store(key, gd);
+}
@@ -0,0 +1,465 @@
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "sdfClient.h"
+
+/* Latency statistics */
+static int calBucket(double us) {
+  if (us < 1.0) {
+    return 0;
+  }
+
+  int e;
+  double m = std::frexp(us, &e); // us = m * 2^e, m in [0.5, 1)
+  int sub = int((m * 2.0 - 1.0) * 4.0);
+  return std::min(1 + (e - 1) * 4 + sub, nOfLatencyBuckets - 1);
+}
+
+void addLatency(ClientStats &stats, double us) {
+  stats.nOfRequests++;
+  stats.totalUs += us;
+  stats.maxUs = std::max(stats.maxUs, us);
+  stats.histogram[calBucket(us)]++;
+}
+
+double calPercentile(const ClientStats &stats, double q) {
+  uint64_t total = 0;
+  for (int b = 0; b < nOfLatencyBuckets; b++) {
+    total += stats.histogram[b];
+  }
+
+  uint64_t rank = uint64_t(std::ceil(q * double(total)));
+  uint64_t count = 0;
+  for (int b = 0; b < nOfLatencyBuckets; b++) {
+    count += stats.histogram[b];
+    if (count >= rank && count > 0) {
+      if (b == 0) {
+        return 1.0;
+      }
+      int e = (b - 1) / 4;
+      int sub = (b - 1) % 4;
+      return std::min(std::ldexp(1.0 + (sub + 1) * 0.25, e), stats.maxUs);
+    }
+  }
+
+  return 0.0;
+}
+
+/* Shared memory */
+// header : magic "SDFM", version, origin, cellSize, nOfCells
+// cells  : sd as floats, x fastest
+static const char sharedMagic[4] = {'S', 'D', 'F', 'M'};
+static const uint32_t sharedVersion = 1;
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  vec3 origin;
+  float cellSize;
+  ivec3 nOfCells;
+  uint32_t padding;
+} SharedHeader;
+
+SharedField::~SharedField() {
+  if (base != nullptr) {
+    munmap(base, size);
+  }
+  if (roFd >= 0) {
+    ::close(roFd);
+  }
+}
+
+// The object is unlinked right away, it lives as long as a descriptor or
+// a mapping of it, and nothing is left behind if the daemon is killed.
+// It is opened a second time read-only, and only that descriptor is handed
+// out, so clients cannot write to it.
+bool SharedField::create(const Grid &gd) {
+  static int counter = 0;
+  string name = "/sdf3d." + to_string(getpid()) + "." + to_string(counter++);
+
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    cout << "failed to create shared memory : " << name << std::endl;
+    return false;
+  }
+  roFd = shm_open(name.c_str(), O_RDONLY, 0);
+  shm_unlink(name.c_str());
+
+  size = sizeof(SharedHeader) + gd.cells.size() * sizeof(float);
+  if (roFd < 0 || ftruncate(fd, off_t(size)) != 0) {
+    cout << "failed to size shared memory : " << name << std::endl;
+    ::close(fd);
+    return false;
+  }
+
+  void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+
+  SharedHeader header;
+  std::memcpy(header.magic, sharedMagic, 4);
+  header.version = sharedVersion;
+  header.origin = gd.origin;
+  header.cellSize = gd.cellSize;
+  header.nOfCells = gd.nOfCells;
+  header.padding = 0;
+  std::memcpy(mapped, &header, sizeof(header));
+
+  float *values = reinterpret_cast<float *>(static_cast<char *>(mapped) +
+                                            sizeof(header));
+  for (size_t i = 0; i < gd.cells.size(); i++) {
+    values[i] = gd.cells[i].sd;
+  }
+
+  base = mapped;
+  origin = gd.origin;
+  cellSize = gd.cellSize;
+  nOfCells = gd.nOfCells;
+  sd = values;
+
+  return true;
+}
+
+bool SharedField::map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SharedHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  size_t n = size_t(st.st_size);
+  void *mapped = mmap(nullptr, n, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+
+  SharedHeader header;
+  std::memcpy(&header, mapped, sizeof(header));
+  size_t nOfValues = size_t(header.nOfCells.x) * header.nOfCells.y *
+                     header.nOfCells.z;
+
+  if (std::memcmp(header.magic, sharedMagic, 4) ||
+      header.version != sharedVersion ||
+      n != sizeof(header) + nOfValues * sizeof(float)) {
+    munmap(mapped, n);
+    return false;
+  }
+
+  if (base != nullptr) {
+    munmap(base, size);
+  }
+
+  base = mapped;
+  size = n;
+  origin = header.origin;
+  cellSize = header.cellSize;
+  nOfCells = header.nOfCells;
+  sd = reinterpret_cast<const float *>(static_cast<const char *>(mapped) +
+                                       sizeof(header));
+
+  return true;
+}
+
+FieldInfo SharedField::getInfo() const {
+  FieldInfo info;
+  info.origin = origin;
+  info.cellSize = cellSize;
+  info.nOfCells = nOfCells;
+  info.nOfFields = 0;
+  info.size = size;
+  return info;
+}
+
+static inline int floorToInt(float f) {
+  int i = int(f);
+  return i - (f < float(i));
+}
+
+// as Grid::getDistances, on the distances alone
+void SharedField::getDistances(const float *px, const float *py,
+                               const float *pz, float *out, int n) const {
+  int nxy = nOfCells.x * nOfCells.y;
+
+  for (int i = 0; i < n; i++) {
+    int ix = floorToInt((px[i] - origin.x) / cellSize);
+    int iy = floorToInt((py[i] - origin.y) / cellSize);
+    int iz = floorToInt((pz[i] - origin.z) / cellSize);
+
+    bool inside = (ix >= 0) & (ix < nOfCells.x) & (iy >= 0) &
+                  (iy < nOfCells.y) & (iz >= 0) & (iz < nOfCells.z);
+    int hash = inside ? (ix + iy * nOfCells.x + iz * nxy) : 0;
+
+    out[i] = inside ? sd[hash] : 9999.f;
+  }
+}
+
+// as Grid::getGradients
+void SharedField::getGradients(const float *px, const float *py,
+                               const float *pz, float *gx, float *gy,
+                               float *gz, int n) const {
+  const int blockSize = 64;
+  float sx[blockSize], sy[blockSize], sz[blockSize];
+  float dPlus[blockSize], dMinus[blockSize];
+
+  for (int begin = 0; begin < n; begin += blockSize) {
+    int count = std::min(blockSize, n - begin);
+
+    for (int axis = 0; axis < 3; axis++) {
+      float *g = (axis == 0) ? gx : ((axis == 1) ? gy : gz);
+      vec3 offset(0.f);
+      offset[axis] = cellSize;
+
+      for (int i = 0; i < count; i++) {
+        sx[i] = px[begin + i] + offset.x;
+        sy[i] = py[begin + i] + offset.y;
+        sz[i] = pz[begin + i] + offset.z;
+      }
+      getDistances(sx, sy, sz, dPlus, count);
+
+      for (int i = 0; i < count; i++) {
+        sx[i] = px[begin + i] - offset.x;
+        sy[i] = py[begin + i] - offset.y;
+        sz[i] = pz[begin + i] - offset.z;
+      }
+      getDistances(sx, sy, sz, dMinus, count);
+
+      for (int i = 0; i < count; i++) {
+        g[begin + i] = dMinus[i] - dPlus[i]; // -grad
+      }
+    }
+
+    for (int i = begin; i < begin + count; i++) {
+      float len = std::sqrt(gx[i] * gx[i] + gy[i] * gy[i] + gz[i] * gz[i]);
+      float inv = 1.f / len;
+      gx[i] *= inv;
+      gy[i] *= inv;
+      gz[i] *= inv;
+    }
+  }
+}
+
+void SharedField::getBounds(vec3 &boxMin, vec3 &boxMax) const {
+  boxMin = origin;
+  boxMax = origin + vec3(nOfCells) * cellSize;
+}
+
+/* Socket helpers */
+bool sendAll(int fd, const void *data, size_t n) {
+  const char *p = static_cast<const char *>(data);
+  while (n > 0) {
+    ssize_t sent = send(fd, p, n, 0);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    p += sent;
+    n -= size_t(sent);
+  }
+  return true;
+}
+
+bool recvAll(int fd, void *data, size_t n) {
+  char *p = static_cast<char *>(data);
+  while (n > 0) {
+    ssize_t received = recv(fd, p, n, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    p += received;
+    n -= size_t(received);
+  }
+  return true;
+}
+
+bool sendWithFd(int fd, const void *data, size_t n, int attached) {
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = n;
+
+  char control[CMSG_SPACE(sizeof(int))];
+  std::memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &attached, sizeof(int));
+
+  // the descriptor goes with the first byte, the rest may follow
+  ssize_t sent = sendmsg(fd, &msg, 0);
+  if (sent <= 0) {
+    return false;
+  }
+  return sendAll(fd, static_cast<const char *>(data) + sent, n - size_t(sent));
+}
+
+bool recvWithFd(int fd, void *data, size_t n, int &attached) {
+  struct iovec iov;
+  iov.iov_base = data;
+  iov.iov_len = n;
+
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  attached = -1;
+  ssize_t received = recvmsg(fd, &msg, 0);
+  if (received <= 0) {
+    return false;
+  }
+
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    std::memcpy(&attached, CMSG_DATA(cmsg), sizeof(int));
+  }
+
+  return recvAll(fd, static_cast<char *>(data) + received,
+                 n - size_t(received));
+}
+
+/* Client */
+bool SdfClient::connect(const string path) {
+  close();
+
+  struct sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+
+  if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof(addr)) != 0) {
+    cout << "failed to connect : " << path << std::endl;
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+void SdfClient::close() {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+bool SdfClient::getInfo(uint32_t field, FieldInfo &info) {
+  RequestHeader request = {requestInfo, field, 0};
+  ResponseHeader response;
+
+  return sendAll(fd, &request, sizeof(request)) &&
+         recvAll(fd, &response, sizeof(response)) && response.status == 0 &&
+         recvAll(fd, &info, sizeof(info));
+}
+
+// x, y, z go out in one message, the results come back into out
+bool SdfClient::query(uint32_t type, uint32_t field, const float *px,
+                      const float *py, const float *pz, float *out, int n) {
+  if (n < 0 || uint32_t(n) > maxPoints) {
+    return false;
+  }
+
+  buffer.resize(sizeof(RequestHeader) / sizeof(float) + 3 * size_t(n));
+  RequestHeader request = {type, field, uint32_t(n)};
+  std::memcpy(buffer.data(), &request, sizeof(request));
+
+  float *payload = buffer.data() + sizeof(RequestHeader) / sizeof(float);
+  std::memcpy(payload, px, n * sizeof(float));
+  std::memcpy(payload + n, py, n * sizeof(float));
+  std::memcpy(payload + 2 * n, pz, n * sizeof(float));
+
+  size_t nOfResults = (type == requestGradients) ? 3 * size_t(n) : size_t(n);
+  ResponseHeader response;
+
+  return sendAll(fd, buffer.data(), buffer.size() * sizeof(float)) &&
+         recvAll(fd, &response, sizeof(response)) && response.status == 0 &&
+         recvAll(fd, out, nOfResults * sizeof(float));
+}
+
+bool SdfClient::getDistances(uint32_t field, const float *px,
+                             const float *py, const float *pz, float *out,
+                             int n) {
+  return query(requestDistances, field, px, py, pz, out, n);
+}
+
+bool SdfClient::getGradients(uint32_t field, const float *px,
+                             const float *py, const float *pz, float *gx,
+                             float *gy, float *gz, int n) {
+  vector<float> out(3 * size_t(n));
+  if (!query(requestGradients, field, px, py, pz, out.data(), n)) {
+    return false;
+  }
+
+  std::memcpy(gx, out.data(), n * sizeof(float));
+  std::memcpy(gy, out.data() + n, n * sizeof(float));
+  std::memcpy(gz, out.data() + 2 * n, n * sizeof(float));
+  return true;
+}
+
+bool SdfClient::mapField(uint32_t field, SharedField &shared) {
+  RequestHeader request = {requestMap, field, 0};
+  if (!sendAll(fd, &request, sizeof(request))) {
+    return false;
+  }
+
+  // the descriptor comes with the response header
+  ResponseHeader response;
+  int attached;
+  if (!recvWithFd(fd, &response, sizeof(response), attached)) {
+    return false;
+  }
+
+  FieldInfo info;
+  if (response.status != 0 || !recvAll(fd, &info, sizeof(info)) ||
+      attached < 0) {
+    if (attached >= 0) {
+      ::close(attached);
+    }
+    return false;
+  }
+
+  return shared.map(attached);
+}
+
+bool SdfClient::getStats(ClientStats &stats) {
+  RequestHeader request = {requestStats, 0, 0};
+  ResponseHeader response;
+
+  return sendAll(fd, &request, sizeof(request)) &&
+         recvAll(fd, &response, sizeof(response)) && response.status == 0 &&
+         recvAll(fd, &stats, sizeof(stats));
+}
@@ -0,0 +1,348 @@
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "sdfCache.h"
+#include "sdfClient.h"
+
+// Serves fields to the processes of one machine, see sdfClient.h.
+//
+// usage: sdfDaemon [socketPath] [fieldFile]...
+//   socketPath : /tmp/sdf3d.sock by default
+//   fieldFile  : fields in the format of readSdfBatty or writeSdf, numbered
+//                from 0 in the order given, sdfBunnyBatty.txt by default
+//
+// Every field is loaded once into shared memory. Each connection has its
+// own thread, which reads a request and hands queries to one batch thread.
+// The batch thread takes every query waiting at that moment and answers
+// them together on the thread pool, so many small requests from several
+// clients cost one parallel loop instead of one each.
+// Statistics of a connection are printed when it closes.
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::micro> Us;
+
+/* A query waiting for the batch thread */
+typedef struct {
+  const SharedField *field;
+  bool gradients;
+  const float *px, *py, *pz; // count each
+  float *out;                // count, or 3 * count for gradients
+  int count;
+  bool coalesced; // answered in the same batch as another request
+  bool done;
+} Query;
+
+string socketPath = "/tmp/sdf3d.sock";
+vector<std::unique_ptr<SharedField>> fields;
+SdfCache cache;
+
+std::mutex queueMtx;
+std::condition_variable queued, answered;
+std::deque<Query *> queue;
+
+const int chunkSize = 4096; // points per task of a batch
+
+void loadFields(const vector<string> &);
+void batchLoop();
+void serveClient(int, int);
+void answer(Query &, int, int);
+void removeSocket(int);
+
+int main(int argc, char const *argv[]) {
+  if (argc > 1) {
+    socketPath = argv[1];
+  }
+
+  vector<string> files;
+  for (int a = 2; a < argc; a++) {
+    files.push_back(argv[a]);
+  }
+  if (files.empty()) {
+    files.push_back("sdfBunnyBatty.txt");
+  }
+
+  loadFields(files);
+  if (fields.empty()) {
+    return 1;
+  }
+
+  struct sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(addr.sun_path)) {
+    std::cout << "socket path too long : " << socketPath << '\n';
+    return 1;
+  }
+  std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socketPath.c_str()); // left behind by a daemon that was killed
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(listener, 64) != 0) {
+    std::cout << "failed to listen on : " << socketPath << '\n';
+    return 1;
+  }
+
+  // a client that hangs up early must not kill the daemon
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, removeSocket);
+  signal(SIGTERM, removeSocket);
+
+  std::thread(batchLoop).detach();
+
+  std::cout << "serving " << fields.size() << " fields on " << socketPath
+            << std::endl;
+
+  int nOfClients = 0;
+  while (true) {
+    int client = accept(listener, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+    std::thread(serveClient, client, nOfClients++).detach();
+  }
+
+  return 0;
+}
+
+void removeSocket(int) {
+  unlink(socketPath.c_str());
+  _exit(0);
+}
+
+// writeSdf files carry the grid parameters only implicitly, in the
+// positions and indices of the cells
+static void readSdfWithParams(Grid &gd, const string fileName) {
+  readSdf(gd, fileName);
+  if (gd.cells.empty()) {
+    return;
+  }
+
+  const Cell &first = gd.cells.front();
+  const Cell &last = gd.cells.back();
+  gd.origin = first.pos; // of cell (0, 0, 0)
+  gd.nOfCells = last.idx + ivec3(1);
+
+  int axis = (gd.nOfCells.x > 1) ? 0 : ((gd.nOfCells.y > 1) ? 1 : 2);
+  gd.cellSize = (gd.nOfCells[axis] > 1)
+                    ? (last.pos[axis] - first.pos[axis]) /
+                          float(gd.nOfCells[axis] - 1)
+                    : 1.f;
+}
+
+// Batty's files start with the number of cells alone on the first line,
+// writeSdf's with the seven or eight columns of a cell
+void loadFields(const vector<string> &files) {
+  for (size_t f = 0; f < files.size(); f++) {
+    ifstream fin(files[f]);
+    string line;
+    if (!std::getline(fin, line)) {
+      std::cout << "failed to open file : " << files[f] << '\n';
+      fields.clear();
+      return;
+    }
+
+    std::istringstream tokens(line);
+    string token;
+    int nOfTokens = 0;
+    while (tokens >> token) {
+      nOfTokens++;
+    }
+
+    Grid grid;
+    if (nOfTokens == 3) {
+      readSdfCached(grid, files[f], readSdfBatty, "batty", cache);
+    } else {
+      readSdfCached(grid, files[f], readSdfWithParams, "params", cache);
+    }
+
+    std::unique_ptr<SharedField> shared(new SharedField());
+    if (!shared->create(grid)) {
+      fields.clear();
+      return;
+    }
+
+    std::cout << f << " : " << files[f] << ", " << grid.nOfCells.x << " x "
+              << grid.nOfCells.y << " x " << grid.nOfCells.z << " cells, "
+              << shared->getSize() / 1048576.0 << " MB shared, cell size "
+              << grid.cellSize << std::endl;
+
+    fields.push_back(std::move(shared));
+  }
+}
+
+void answer(Query &q, int begin, int end) {
+  int n = end - begin;
+  if (q.gradients) {
+    q.field->getGradients(q.px + begin, q.py + begin, q.pz + begin,
+                          q.out + begin, q.out + q.count + begin,
+                          q.out + 2 * q.count + begin, n);
+  } else {
+    q.field->getDistances(q.px + begin, q.py + begin, q.pz + begin,
+                          q.out + begin, n);
+  }
+}
+
+// every query waiting at the moment becomes one parallel loop
+void batchLoop() {
+  typedef struct {
+    Query *query;
+    int begin, end;
+  } Task;
+
+  vector<Query *> batch;
+  vector<Task> tasks;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(queueMtx);
+      queued.wait(lock, [] { return !queue.empty(); });
+      batch.assign(queue.begin(), queue.end());
+      queue.clear();
+    }
+
+    tasks.clear();
+    for (size_t i = 0; i < batch.size(); i++) {
+      for (int b = 0; b < batch[i]->count; b += chunkSize) {
+        Task task = {batch[i], b, std::min(b + chunkSize, batch[i]->count)};
+        tasks.push_back(task);
+      }
+    }
+
+    if (tasks.size() > 1) {
+      parallelFor(int(tasks.size()), [&](int begin, int end) {
+        for (int t = begin; t < end; t++) {
+          answer(*tasks[t].query, tasks[t].begin, tasks[t].end);
+        }
+      });
+    } else if (tasks.size() == 1) {
+      answer(*tasks[0].query, tasks[0].begin, tasks[0].end);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(queueMtx);
+      for (size_t i = 0; i < batch.size(); i++) {
+        batch[i]->coalesced = (batch.size() > 1);
+        batch[i]->done = true;
+      }
+    }
+    answered.notify_all();
+  }
+}
+
+static bool sendResponse(int fd, int32_t status, uint32_t count,
+                         const void *payload, size_t size) {
+  ResponseHeader response = {status, count};
+  return sendAll(fd, &response, sizeof(response)) &&
+         (size == 0 || sendAll(fd, payload, size));
+}
+
+void serveClient(int fd, int id) {
+  ClientStats stats;
+  std::memset(&stats, 0, sizeof(stats));
+
+  vector<float> in, out;
+  RequestHeader request;
+
+  while (recvAll(fd, &request, sizeof(request))) {
+    bool isQuery = (request.type == requestDistances ||
+                    request.type == requestGradients);
+    if (isQuery && request.count > maxPoints) {
+      sendResponse(fd, -3, 0, nullptr, 0);
+      break; // the payload cannot be skipped safely
+    }
+
+    if (isQuery) {
+      in.resize(3 * size_t(request.count));
+      if (!recvAll(fd, in.data(), in.size() * sizeof(float))) {
+        break;
+      }
+    }
+
+    Clock::time_point start = Clock::now();
+
+    if (request.field >= fields.size() && request.type != requestStats) {
+      if (!sendResponse(fd, -1, 0, nullptr, 0)) {
+        break;
+      }
+      continue;
+    }
+
+    bool sent = false;
+    if (request.type == requestInfo) {
+      FieldInfo info = fields[request.field]->getInfo();
+      info.nOfFields = uint32_t(fields.size());
+      sent = sendResponse(fd, 0, 1, &info, sizeof(info));
+    } else if (isQuery) {
+      int n = int(request.count);
+      bool gradients = (request.type == requestGradients);
+      out.resize(gradients ? 3 * size_t(n) : size_t(n));
+
+      Query q = {fields[request.field].get(),
+                 gradients,
+                 in.data(),
+                 in.data() + n,
+                 in.data() + 2 * n,
+                 out.data(),
+                 n,
+                 false,
+                 false};
+      {
+        std::unique_lock<std::mutex> lock(queueMtx);
+        queue.push_back(&q);
+        queued.notify_one();
+        answered.wait(lock, [&] { return q.done; });
+      }
+
+      stats.nOfPoints += request.count;
+      stats.nOfCoalesced += q.coalesced;
+      sent = sendResponse(fd, 0, request.count, out.data(),
+                          out.size() * sizeof(float));
+    } else if (request.type == requestMap) {
+      const SharedField &shared = *fields[request.field];
+      FieldInfo info = shared.getInfo();
+      info.nOfFields = uint32_t(fields.size());
+
+      ResponseHeader response = {0, 1};
+      sent = sendWithFd(fd, &response, sizeof(response),
+                        shared.getReadOnlyFd()) &&
+             sendAll(fd, &info, sizeof(info));
+    } else if (request.type == requestStats) {
+      sent = sendResponse(fd, 0, 1, &stats, sizeof(stats));
+    } else {
+      sent = sendResponse(fd, -2, 0, nullptr, 0);
+    }
+
+    if (!sent) {
+      break;
+    }
+
+    // from a whole request received to its response sent
+    addLatency(stats, Us(Clock::now() - start).count());
+  }
+
+  close(fd);
+
+  if (stats.nOfRequests > 0) {
+    std::ostringstream line;
+    line << "client " << id << " : " << stats.nOfRequests << " requests, "
+         << stats.nOfPoints << " points, " << stats.nOfCoalesced
+         << " batched with others, latency mean "
+         << stats.totalUs / double(stats.nOfRequests) << " us, p50 "
+         << calPercentile(stats, 0.5) << " us, p99 "
+         << calPercentile(stats, 0.99) << " us, max " << stats.maxUs << " us"
+         << '\n';
+    std::cout << line.str() << std::flush;
+  }
+}
@@ -0,0 +1,179 @@
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <thread>
+#include "sdfClient.h"
+
+// Load generator for sdfDaemon.
+//
+// usage: sdfLoad [socketPath] [nOfClients] [batchSize] [seconds] [mode]
+//                [field]
+//   socketPath : /tmp/sdf3d.sock by default
+//   nOfClients : connections, each on its own thread, 4 by default
+//   batchSize  : points per request, 1024 by default
+//   seconds    : length of the run, 5 by default
+//   mode       : distances (default), gradients, or local to sample a
+//                shared mapping of the field without the socket
+//   field      : number of the field in the daemon, 0 by default
+//
+// Points are uniform in the box of the field. Before the run every client
+// maps the field and checks that the daemon answers its first batch the
+// same as the mapping does. Each client reports its own latencies and
+// those the daemon measured for its connection.
+
+typedef std::chrono::steady_clock Clock;
+typedef std::chrono::duration<double, std::micro> Us;
+
+string socketPath = "/tmp/sdf3d.sock";
+int nOfClients = 4;
+int batchSize = 1024;
+double seconds = 5.0;
+string mode = "distances";
+uint32_t field = 0;
+
+typedef struct {
+  ClientStats local;  // measured by the client, round trips
+  ClientStats server; // measured by the daemon
+  int nOfMismatches;
+  bool ok;
+} Report;
+
+void runClient(int, Report &);
+void printStats(const string, const ClientStats &, double);
+
+int main(int argc, char const *argv[]) {
+  if (argc > 1) {
+    socketPath = argv[1];
+  }
+  if (argc > 2) {
+    nOfClients = std::max(atoi(argv[2]), 1);
+  }
+  if (argc > 3) {
+    batchSize = std::min(std::max(atoi(argv[3]), 1), int(maxPoints));
+  }
+  if (argc > 4) {
+    seconds = atof(argv[4]);
+  }
+  if (argc > 5) {
+    mode = argv[5];
+  }
+  if (argc > 6) {
+    field = uint32_t(atoi(argv[6]));
+  }
+
+  vector<Report> reports(nOfClients);
+  vector<std::thread> clients;
+  for (int c = 0; c < nOfClients; c++) {
+    clients.push_back(std::thread(runClient, c, std::ref(reports[c])));
+  }
+  for (size_t c = 0; c < clients.size(); c++) {
+    clients[c].join();
+  }
+
+  uint64_t nOfPoints = 0;
+  for (int c = 0; c < nOfClients; c++) {
+    const Report &r = reports[c];
+    if (!r.ok) {
+      std::cout << "client " << c << " failed" << '\n';
+      continue;
+    }
+
+    std::cout << "client " << c << " (" << mode << "), "
+              << r.nOfMismatches << " mismatches" << '\n';
+    printStats("  round trip", r.local, seconds);
+    if (mode != "local") {
+      printStats("  in daemon ", r.server, seconds);
+    }
+    nOfPoints += r.local.nOfPoints;
+  }
+
+  std::cout << nOfPoints / seconds / 1e6 << " M points/s over "
+            << nOfClients << " clients" << '\n';
+
+  return 0;
+}
+
+void printStats(const string name, const ClientStats &stats,
+                double seconds) {
+  std::ostringstream line;
+  line << name << " : " << stats.nOfRequests / seconds << " requests/s, "
+       << "mean "
+       << stats.totalUs / double(std::max(stats.nOfRequests, uint64_t(1)))
+       << " us, p50 " << calPercentile(stats, 0.5) << " us, p99 "
+       << calPercentile(stats, 0.99) << " us, max " << stats.maxUs << " us";
+  if (stats.nOfCoalesced > 0) {
+    line << ", " << stats.nOfCoalesced << " batched with others";
+  }
+  std::cout << line.str() << '\n';
+}
+
+void runClient(int id, Report &report) {
+  std::memset(&report, 0, sizeof(report));
+
+  SdfClient client;
+  FieldInfo info;
+  SharedField shared;
+  if (!client.connect(socketPath) || !client.getInfo(field, info) ||
+      !client.mapField(field, shared)) {
+    return;
+  }
+
+  vec3 boxMin, boxMax;
+  shared.getBounds(boxMin, boxMax);
+
+  std::mt19937 rng(id + 1);
+  std::uniform_real_distribution<float> ux(boxMin.x, boxMax.x);
+  std::uniform_real_distribution<float> uy(boxMin.y, boxMax.y);
+  std::uniform_real_distribution<float> uz(boxMin.z, boxMax.z);
+
+  size_t n = size_t(batchSize);
+  vector<float> px(n), py(n), pz(n), d(n), expected(n), gy(n), gz(n);
+  auto refill = [&]() {
+    for (size_t i = 0; i < n; i++) {
+      px[i] = ux(rng);
+      py[i] = uy(rng);
+      pz[i] = uz(rng);
+    }
+  };
+
+  // the daemon and the mapping must agree
+  refill();
+  shared.getDistances(px.data(), py.data(), pz.data(), expected.data(),
+                      batchSize);
+  if (!client.getDistances(field, px.data(), py.data(), pz.data(),
+                           d.data(), batchSize)) {
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    report.nOfMismatches += (d[i] != expected[i]);
+  }
+
+  Clock::time_point end =
+      Clock::now() + std::chrono::microseconds(int64_t(seconds * 1e6));
+
+  while (Clock::now() < end) {
+    refill();
+
+    Clock::time_point start = Clock::now();
+    bool ok = true;
+    if (mode == "local") {
+      shared.getDistances(px.data(), py.data(), pz.data(), d.data(),
+                          batchSize);
+    } else if (mode == "gradients") {
+      ok = client.getGradients(field, px.data(), py.data(), pz.data(),
+                               d.data(), gy.data(), gz.data(), batchSize);
+    } else {
+      ok = client.getDistances(field, px.data(), py.data(), pz.data(),
+                               d.data(), batchSize);
+    }
+    if (!ok) {
+      return;
+    }
+
+    addLatency(report.local, Us(Clock::now() - start).count());
+    report.local.nOfPoints += n;
+  }
+
+  report.ok = (mode == "local") || client.getStats(report.server);
+}
@@ -0,0 +1,179 @@
+#include "sdfUpdate.h"
+#include <unordered_set>
+
+vector<int> findChangedFaces(const Mesh &before, const Mesh &after) {
+  vector<int> changed;
+
+  for (size_t i = 0; i < after.faces.size(); i++) {
+    const Face &face = after.faces[i];
+    if (before.vertices[face.v1] != after.vertices[face.v1] ||
+        before.vertices[face.v2] != after.vertices[face.v2] ||
+        before.vertices[face.v3] != after.vertices[face.v3]) {
+      changed.push_back(int(i));
+    }
+  }
+
+  return changed;
+}
+
+void calFaceBounds(const Mesh &mesh, const vector<int> &faces, vec3 &boxMin,
+                   vec3 &boxMax) {
+  boxMin = vec3(9999.f);
+  boxMax = vec3(-9999.f);
+
+  for (size_t i = 0; i < faces.size(); i++) {
+    const Face &face = mesh.faces[faces[i]];
+    vec3 a = mesh.vertices[face.v1];
+    vec3 b = mesh.vertices[face.v2];
+    vec3 c = mesh.vertices[face.v3];
+    boxMin = min(boxMin, min(a, min(b, c)));
+    boxMax = max(boxMax, max(a, max(b, c)));
+  }
+}
+
+// unsigned distance from p to the closest of the faces
+static float faceDistance(const Mesh &mesh, const vector<int> &faces,
+                          vec3 p) {
+  float nearest = 9999.f;
+
+  for (size_t i = 0; i < faces.size(); i++) {
+    const Face &face = mesh.faces[faces[i]];
+    vec3 bary;
+    vec3 q = closestPoint2Triangle(mesh.vertices[face.v1],
+                                   mesh.vertices[face.v2],
+                                   mesh.vertices[face.v3], p, bary);
+    nearest = std::min(nearest, length(p - q));
+  }
+
+  return nearest;
+}
+
+// Cells reached from the faces through their 6 neighbors while |d| is at
+// least the distance to the faces. The cells are only samples of the
+// field, so the test allows a cell diagonal of slack, which also keeps
+// the region from breaking apart between two samples.
+static void floodFromFaces(const Grid &grid, const Mesh &mesh,
+                           const vector<int> &faces, vector<int> &found,
+                           int &nOfVisited) {
+  ivec3 n = grid.nOfCells;
+  float slack = grid.cellSize * 1.7320508f;
+
+  auto hashOf = [&](ivec3 idx) { return idx.x + n.x * (idx.y + n.y * idx.z); };
+
+  // the cells inside the bounds of every face are the seeds,
+  // edited faces need not be next to each other
+  std::unordered_set<int> visited;
+  vector<int> stack;
+  for (size_t f = 0; f < faces.size(); f++) {
+    vec3 boxMin, boxMax;
+    calFaceBounds(mesh, vector<int>(1, faces[f]), boxMin, boxMax);
+
+    ivec3 lo = clamp(ivec3(floor((boxMin - grid.origin) / grid.cellSize)),
+                     ivec3(0), n - ivec3(1));
+    ivec3 hi = clamp(ivec3(ceil((boxMax - grid.origin) / grid.cellSize)),
+                     ivec3(0), n - ivec3(1));
+
+    for (int k = lo.z; k <= hi.z; k++) {
+      for (int j = lo.y; j <= hi.y; j++) {
+        for (int i = lo.x; i <= hi.x; i++) {
+          int h = hashOf(ivec3(i, j, k));
+          if (visited.insert(h).second) {
+            stack.push_back(h);
+          }
+        }
+      }
+    }
+  }
+
+  const ivec3 neighbors[6] = {ivec3(1, 0, 0), ivec3(-1, 0, 0),
+                              ivec3(0, 1, 0), ivec3(0, -1, 0),
+                              ivec3(0, 0, 1), ivec3(0, 0, -1)};
+
+  while (!stack.empty()) {
+    int h = stack.back();
+    stack.pop_back();
+    nOfVisited++;
+
+    const Cell &cell = grid.cells[h];
+    if (abs(cell.sd) + slack < faceDistance(mesh, faces, cell.pos)) {
+      continue;
+    }
+    found.push_back(h);
+
+    for (int m = 0; m < 6; m++) {
+      ivec3 idx = cell.idx + neighbors[m];
+      if (idx.x < 0 || idx.y < 0 || idx.z < 0 || idx.x >= n.x ||
+          idx.y >= n.y || idx.z >= n.z) {
+        continue;
+      }
+
+      int next = hashOf(idx);
+      if (visited.insert(next).second) {
+        stack.push_back(next);
+      }
+    }
+  }
+}
+
+// The grid holds the field of the mesh before the edit, bvh is built over
+// the mesh after it and faces are the edited faces.
+SdfUpdate updateSdf(Grid &grid, const Mesh &before, const Mesh &after,
+                    const MeshBvh &bvh, const vector<int> &faces) {
+  SdfUpdate result = {0, 0, 0};
+  if (faces.empty()) {
+    return result;
+  }
+
+  bool hasFaces = (grid.faceIds.size() == grid.cells.size());
+  std::unordered_set<int> changedFaces(faces.begin(), faces.end());
+  std::unordered_set<int> marked;
+  vector<int> cells, found;
+
+  // cells that may have lost their closest face
+  floodFromFaces(grid, before, faces, found, result.nOfVisited);
+  for (size_t i = 0; i < found.size(); i++) {
+    int h = found[i];
+    // -1 is a cell whose closest face was never recorded
+    if (!hasFaces || grid.faceIds[h] < 0 ||
+        changedFaces.count(grid.faceIds[h])) {
+      if (marked.insert(h).second) {
+        cells.push_back(h);
+      }
+    }
+  }
+
+  // cells an edited face may have come closer to
+  found.clear();
+  floodFromFaces(grid, after, faces, found, result.nOfVisited);
+  for (size_t i = 0; i < found.size(); i++) {
+    if (marked.insert(found[i]).second) {
+      cells.push_back(found[i]);
+    }
+  }
+
+  // the old closest face is a good hint, it has rarely moved far
+  vector<char> changed(cells.size(), 0);
+  parallelFor(int(cells.size()), [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      Cell &cell = grid.cells[cells[i]];
+      int hint = hasFaces ? grid.faceIds[cells[i]] : -1;
+
+      MeshQuery q = bvh.query(cell.pos, 9999.f, hint);
+      // text files keep 6 digits, smaller differences are not changes
+      changed[i] = (abs(q.distance - cell.sd) > 1e-4f) ||
+                   (hasFaces && q.face != hint);
+
+      cell.sd = q.distance;
+      if (hasFaces) {
+        grid.faceIds[cells[i]] = q.face;
+      }
+    }
+  });
+
+  result.nOfRecomputed = int(cells.size());
+  for (size_t i = 0; i < changed.size(); i++) {
+    result.nOfChanged += changed[i];
+  }
+
+  return result;
+}
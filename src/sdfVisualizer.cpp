@@ -1,5 +1,8 @@
 #include "common.h"
 #include "sdf.h"
+#include "voxelRenderer.h"
+#include "assetLoader.h"
+#include "sdfCache.h"
 
 GLFWwindow *window;
 
@@ -27,17 +30,29 @@ float cellSize = 0.1f;
 vec3 gridOrigin(0, 0, 0);
 vec3 rangeOffset(0.2f, 0.2f, 0.2f);
 Grid grid;
+SdfCache cache; // parsed fields, see sdfCache.h
 
 Mesh mesh;
 
+/* for voxels */
+// cells with sd < isovalue and z <= slice are drawn
+VoxelRenderer voxels;
+float isovalue = 0.f;
+float slice = 9999.f;
+bool voxelsChanged = true;
+
+// the mesh and the field load while GL is set up
+AssetLoader loader;
+
 /* opengl variables */
-GLuint shaderMesh, shaderPoint, shaderLine;
+GLuint shaderMesh, shaderPoint, shaderLine, shaderVoxel;
 GLint uniMeshM, uniMeshV, uniMeshP;
 GLint uniLightColor, uniLightPosition, uniLightPower;
 GLint uniEyePoint;
 
 GLint uniPointM, uniPointV, uniPointP;
 GLint uniLineM, uniLineV, uniLineP;
+GLint uniVoxelM, uniVoxelV, uniVoxelP;
 
 void computeMatricesFromInputs(mat4 &, mat4 &);
 void keyCallback(GLFWwindow *, int, int, int, int);
@@ -51,38 +66,22 @@ void initGrid();
 void initMesh();
 void releaseResource();
 
-void readSdf(Grid &, const string);
-void readSdfBatty(Grid &, const string);
 vec3 calCellPos(vec3);
 float randf();
 
 int main(int argc, char const *argv[]) {
+  loader.add("bunny.obj", [] {
+    mesh = loadObj("./mesh/bunny.obj");
+    findAABB(mesh);
+  }, [] { createMesh(mesh); });
+  loader.add("sdfBunnyBatty.txt", initGrid);
+
   initGL();
   initOther();
   initShader();
   initMatrix();
   initLight();
-
-  initGrid();
-  initMesh();
-
-  // test points
-  std::vector<Point> pts;
-  // for (size_t i = 0; i < 60; i++) {
-  //   Point p;
-  //   p.pos = vec3(randf(), randf(), randf()) * 3.f;
-  //   p.color = vec3(0.5, 0.5, 0.5);
-  //   pts.push_back(p);
-  // }
-  for (size_t i = 0; i < grid.cells.size(); i++) {
-    Cell &cell = grid.cells[i];
-    if (cell.sd < 0) {
-      Point p;
-      p.pos = cell.pos;
-      p.color = vec3(0.5, 0.5, 0.5);
-      pts.push_back(p);
-    }
-  }
+  voxels.init();
 
   /* glfw loop */
   // a rough way to solve cursor position initialization problem
@@ -91,6 +90,26 @@ int main(int argc, char const *argv[]) {
   glfwPollEvents();
   glfwSetCursorPos(window, WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
 
+  // empty frames with the progress in the title until everything is ready
+  while (!loader.poll() && !glfwWindowShouldClose(window)) {
+    glfwSetWindowTitle(window, loader.getStatus().c_str());
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glfwSwapBuffers(window);
+    glfwWaitEventsTimeout(0.02);
+  }
+  glfwSetWindowTitle(window, "With normal mapping");
+
+  // closed while loading, nothing is ready to be used
+  if (!loader.isDone()) {
+    loader.wait();
+    releaseResource();
+    return 0;
+  }
+
+  // needs both the mesh and the grid
+  initMesh();
+
   // for (size_t i = 0; i < pts.size(); i++) {
   //   std::cout << "point: " << to_string(pts[i].pos)
   //             << ", dist = " << grid.getDistance(pts[i].pos) << '\n';
@@ -112,14 +131,23 @@ int main(int argc, char const *argv[]) {
     glUniformMatrix4fv(uniMeshP, 1, GL_FALSE, value_ptr(projection));
     glUniform3fv(uniEyePoint, 1, value_ptr(eyePoint));
 
-    glBindVertexArray(mesh.vao);
-    glDrawArrays(GL_TRIANGLES, 0, mesh.faces.size() * 3);
+    mat4 meshM = model * mesh.model;
+    glUniformMatrix4fv(uniMeshM, 1, GL_FALSE, value_ptr(meshM));
+    drawMesh(mesh);
+
+    // draw the cells inside
+    // the instance buffer is only rebuilt when the selection changes
+    if (voxelsChanged) {
+      voxels.build(grid, isovalue, slice);
+      voxelsChanged = false;
+      std::cout << "isovalue " << isovalue << ", slice " << slice << ": "
+                << voxels.size() << " voxels" << '\n';
+    }
 
-    // draw point
-    glUseProgram(shaderPoint);
-    glUniformMatrix4fv(uniPointV, 1, GL_FALSE, value_ptr(view));
-    glUniformMatrix4fv(uniPointP, 1, GL_FALSE, value_ptr(projection));
-    drawPoints(pts);
+    glUseProgram(shaderVoxel);
+    glUniformMatrix4fv(uniVoxelV, 1, GL_FALSE, value_ptr(view));
+    glUniformMatrix4fv(uniVoxelP, 1, GL_FALSE, value_ptr(projection));
+    voxels.draw(projection * view * model);
 
     // draw line
     // glUseProgram(shaderLine);
@@ -242,6 +270,17 @@ void initMatrix() {
   glUniformMatrix4fv(uniLineM, 1, GL_FALSE, value_ptr(model));
   glUniformMatrix4fv(uniLineV, 1, GL_FALSE, value_ptr(view));
   glUniformMatrix4fv(uniLineP, 1, GL_FALSE, value_ptr(projection));
+
+  // voxel
+  glUseProgram(shaderVoxel);
+
+  uniVoxelM = myGetUniformLocation(shaderVoxel, "M");
+  uniVoxelV = myGetUniformLocation(shaderVoxel, "V");
+  uniVoxelP = myGetUniformLocation(shaderVoxel, "P");
+
+  glUniformMatrix4fv(uniVoxelM, 1, GL_FALSE, value_ptr(model));
+  glUniformMatrix4fv(uniVoxelV, 1, GL_FALSE, value_ptr(view));
+  glUniformMatrix4fv(uniVoxelP, 1, GL_FALSE, value_ptr(projection));
 }
 
 void initLight() { // light
@@ -256,12 +295,18 @@ void initLight() { // light
 
   // uniLightPower = myGetUniformLocation(shaderMesh, "lightPower");
   // glUniform1f(uniLightPower, lightPower);
+
+  // voxel
+  glUseProgram(shaderVoxel);
+  glUniform3fv(myGetUniformLocation(shaderVoxel, "lightPos"), 1,
+               value_ptr(lightPos));
 }
 
 void initShader() {
   shaderMesh = buildShader("./shader/vsPhong.glsl", "./shader/fsPhong.glsl");
   shaderPoint = buildShader("./shader/vsPoint.glsl", "./shader/fsPoint.glsl");
   shaderLine = buildShader("./shader/vsLine.glsl", "./shader/fsLine.glsl");
+  shaderVoxel = buildShader("./shader/vsVoxel.glsl", "./shader/fsVoxel.glsl");
 }
 
 void releaseResource() {
@@ -362,89 +407,10 @@ void initGrid() {
   //
   // readSdf(grid, "sdfBunnyMine.txt");
 
-  readSdfBatty(grid, "sdfBunnyBatty.txt");
+  readSdfCached(grid, "sdfBunnyBatty.txt", readSdfBatty, "batty", cache);
 }
 
 // format: x, y, z, i, j, k, dist
-void readSdf(Grid &gd, const string fileName) {
-  ifstream fin;
-  fin.open(fileName.c_str());
-
-  if (!(fin.good())) {
-    cout << "failed to open file : " << fileName << std::endl;
-  }
-
-  // read file
-  while (fin.peek() != EOF) {
-    Cell cell;
-
-    fin >> cell.pos.x;
-    fin >> cell.pos.y;
-    fin >> cell.pos.z;
-
-    fin >> cell.idx.x;
-    fin >> cell.idx.y;
-    fin >> cell.idx.z;
-
-    fin >> cell.sd;
-
-    gd.cells.push_back(cell);
-  } // end read file
-
-  fin.close();
-}
-
-// SDF generated by SDFGen
-// from https://github.com/christopherbatty
-// note that the <padding> parameter translates the mesh
-// with (dx * padding)
-void readSdfBatty(Grid &gd, const string fileName) {
-  ifstream fin;
-  fin.open(fileName.c_str());
-
-  if (!(fin.good())) {
-    cout << "failed to open file : " << fileName << std::endl;
-  }
-
-  // # of cells
-  fin >> gd.nOfCells.x;
-  fin >> gd.nOfCells.y;
-  fin >> gd.nOfCells.z;
-
-  // origin
-  fin >> gd.origin.x;
-  fin >> gd.origin.y;
-  fin >> gd.origin.z;
-  // assume the origin is always (0, 0, 0)
-  gd.origin = vec3(0);
-
-  // cell size
-  fin >> gd.cellSize;
-
-  // read sdf
-  for (size_t k = 0; k < gd.nOfCells.z; k++) {
-    for (size_t j = 0; j < gd.nOfCells.y; j++) {
-      for (size_t i = 0; i < gd.nOfCells.x; i++) {
-        Cell cell;
-
-        cell.pos = vec3(i * gd.cellSize, j * gd.cellSize, k * gd.cellSize);
-        cell.pos += gd.origin;
-
-        // if padding is 1
-        // cell.pos += vec3(gd.cellSize * 1.f);
-
-        cell.idx = ivec3(i, j, k);
-
-        fin >> cell.sd;
-
-        gd.cells.push_back(cell);
-      }
-    }
-  }
-
-  fin.close();
-}
-
 void initOther() {
   srand(clock());             // random seed
   FreeImage_Initialise(true); // FreeImage library
@@ -458,15 +424,9 @@ float randf() {
 }
 
 void initMesh() {
-  /* prepare mesh data */
-  mesh = loadObj("./mesh/bunny.obj");
-  createMesh(mesh);
-  findAABB(mesh);
-
   // transform mesh to (origin + offset) position
   vec3 offset = (gridOrigin - mesh.min) + rangeOffset;
-  mesh.translate(offset + vec3(-grid.cellSize * 1.f));
-  updateMesh(mesh);
+  mesh.model = translate(mat4(1.f), offset + vec3(-grid.cellSize * 1.f));
 }
 
 void keyCallback(GLFWwindow *keyWnd, int key, int scancode, int action,
@@ -485,6 +445,33 @@ void keyCallback(GLFWwindow *keyWnd, int key, int scancode, int action,
       glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
       break;
     }
+    // isovalue
+    case GLFW_KEY_EQUAL: {
+      isovalue += grid.cellSize * 0.5f;
+      voxelsChanged = true;
+      break;
+    }
+    case GLFW_KEY_MINUS: {
+      isovalue -= grid.cellSize * 0.5f;
+      voxelsChanged = true;
+      break;
+    }
+    // slice along z, starts above the grid
+    case GLFW_KEY_LEFT_BRACKET: {
+      if (!loader.isDone()) {
+        break;
+      }
+      vec3 lo, hi;
+      grid.getBounds(lo, hi);
+      slice = std::min(slice, hi.z) - grid.cellSize;
+      voxelsChanged = true;
+      break;
+    }
+    case GLFW_KEY_RIGHT_BRACKET: {
+      slice += grid.cellSize;
+      voxelsChanged = true;
+      break;
+    }
     case GLFW_KEY_I: {
       std::cout << "eyePoint: " << to_string(eyePoint) << '\n';
       std::cout << "verticleAngle: " << fmod(verticalAngle, 6.28f) << ", "
@@ -1,5 +1,14 @@
+#include <chrono>
 #include "common.h"
 #include "sdf.h"
+#include "spatialHash.h"
+#include "collider.h"
+#include "rigidBody.h"
+#include "recorder.h"
+#include "capture.h"
+#include "tripleBuffer.h"
+#include "assetLoader.h"
+#include "sdfCache.h"
 
 GLint uniParM, uniParV, uniParP;
 GLint uniMeshM, uniMeshV, uniMeshP;
@@ -9,6 +18,7 @@ GLFWwindow *window;
 GLuint shaderPar, shaderSphere;
 Particles particles;
 Mesh mesh;
+Mesh monkey;
 
 void initGL();
 void initOther();
@@ -18,17 +28,45 @@ void initMesh();
 void initMatrix();
 void initUniform();
 void initGrid();
+void initScene();
+void updateScene();
+void initBodies();
 void releaseResource();
 void step();
-void loadPoints(Particles &, const string);
+void simLoop();
+void publishSnapshot();
 void computeMatricesFromInputs();
 void keyCallback(GLFWwindow *, int, int, int, int);
-void readSdf(Grid &, const string);
-void readSdfBatty(Grid &, const string);
-float randf();
 
 float dt = 0.01;
 vec3 g(0, -9.8, 0);
+SimParams simParams = {dt, g, 0.1f, 0.3f, 0.05f, 500.f, 5.f, false};
+SpatialHash spatialHash;
+unsigned seed = 1; // same seed, same initial velocities
+
+// for performance report
+double stepTime = 0.0;
+int nOfTimedSteps = 0;
+
+// for trajectory recording, toggled with R
+Recorder recorder;
+unsigned stepNumber = 0;
+
+/* for pipelining */
+// The simulation runs on its own thread at a fixed time step, and hands
+// the state to draw to the render thread (main) through snapshots.
+// simMtx guards the simulation state against the key callback.
+typedef struct {
+  FloatArray x, y, z;     // particle positions
+  vector<mat4> instanceM; // model matrices of the collider instances
+  vector<mat4> bodyM;     // model matrices of the rigid bodies
+} Snapshot;
+
+TripleBuffer<Snapshot> snapshots;
+std::thread simThread;
+std::atomic<bool> simRunning(false);
+std::mutex simMtx;
+int maxStepsPerUpdate = 4; // the simulation falls behind rather than spiral
 
 // for view control
 float verticalAngle = -1.88085;
@@ -54,21 +92,58 @@ float cellSize = 0.1f;
 vec3 gridOrigin(0, 0, 0);
 vec3 rangeOffset(0.2f, 0.2f, 0.2f);
 Grid grid;
-
-unsigned int frameNumber = 0;
+SdfCache cache; // parsed fields, see sdfCache.h
+
+/* for colliders */
+// every instance shares grid
+ColliderScene scene;
+int spinningInstance;
+
+/* for rigid bodies */
+vector<RigidShape> shapes;
+vector<RigidBody> bodies;
+ContactList contacts;
+RigidParams rigidParams = {dt, g, 0.05f, 0.2f, 0.3f};
+int nOfBodies = 64;
+
+// for saving frames, toggled with Y
+// must use WINDOW_WIDTH * 2 and WINDOW_HEIGHT * 2 on OSX
+// maybe because of the retina display
+FrameWriter frameWriter;
+FrameCapture frameCapture;
 bool saveTrigger = true;
 
+// meshes, the field and the particles load while GL is set up
+AssetLoader loader;
+
 int main(int argc, char **argv) {
+  // parsing only, buffers are created by the upload steps on this thread
+  loader.add("bunny.obj", [] {
+    mesh = loadObj("./mesh/bunny.obj");
+    findAABB(mesh);
+  }, [] { createMesh(mesh); });
+  loader.add("monkey.obj", [] {
+    monkey = loadObj("./mesh/monkey.obj");
+    monkey.scale(vec3(0.3f));
+    shapes.resize(1);
+    shapes[0].create(monkey.vertices, 1.f);
+  }, [] { createMesh(monkey); });
+  loader.add("sdfBunnyBatty.txt", [] {
+    initGrid();
+    initScene();
+  });
+  loader.add("particles.txt", [] {
+    loadParticles(particles.state, "particles.txt", vec3(0, 4.f, 0), seed);
+  }, initParticles);
+
   initGL();
   initOther();
   initShader();
   initMatrix();
   initUniform();
 
-  initParticles();
-
-  initMesh();
-  initGrid();
+  frameWriter.start("./result/output", WINDOW_WIDTH * 2, WINDOW_HEIGHT * 2);
+  frameCapture.start(&frameWriter);
 
   // a rough way to solve cursor position initialization problem
   // must call glfwPollEvents once to activate glfwSetCursorPos
@@ -76,6 +151,32 @@ int main(int argc, char **argv) {
   glfwPollEvents();
   glfwSetCursorPos(window, WINDOW_WIDTH / 2, WINDOW_HEIGHT / 2);
 
+  // empty frames with the progress in the title until everything is ready
+  while (!loader.poll() && !glfwWindowShouldClose(window)) {
+    glfwSetWindowTitle(window, loader.getStatus().c_str());
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glfwSwapBuffers(window);
+    glfwWaitEventsTimeout(0.02);
+  }
+  glfwSetWindowTitle(window, "With normal mapping");
+
+  // closed while loading, nothing is ready to be used
+  if (!loader.isDone()) {
+    loader.wait();
+    releaseResource();
+    return 0;
+  }
+
+  // needs both the meshes and the grid
+  initMesh();
+  initBodies();
+
+  // the first frame draws the initial state
+  publishSnapshot();
+  simRunning = true;
+  simThread = std::thread(simLoop);
+
   /* Loop until the user closes the window */
   while (!glfwWindowShouldClose(window)) {
     /* Render here */
@@ -85,8 +186,10 @@ int main(int argc, char **argv) {
     // view control
     computeMatricesFromInputs();
 
-    // simulation
-    step();
+    // latest state of the simulation
+    // frame N is drawn while the simulation thread computes the next ones
+    snapshots.consume();
+    const Snapshot &snap = snapshots.getFront();
 
     // draw points
     glUseProgram(shaderPar);
@@ -94,7 +197,7 @@ int main(int argc, char **argv) {
     glUniformMatrix4fv(uniParV, 1, GL_FALSE, value_ptr(commonV));
     glUniformMatrix4fv(uniParP, 1, GL_FALSE, value_ptr(commonP));
 
-    drawPoints(particles);
+    drawPoints(particles, snap.x, snap.y, snap.z);
 
     // draw mesh
     glUseProgram(shaderSphere);
@@ -104,28 +207,23 @@ int main(int argc, char **argv) {
 
     glUniform3fv(uniEyePoint, 1, value_ptr(eyePoint));
 
-    glBindVertexArray(mesh.vao);
-    glDrawArrays(GL_TRIANGLES, 0, mesh.faces.size() * 3);
+    // one draw per collider instance
+    for (size_t i = 0; i < snap.instanceM.size(); i++) {
+      mat4 M = snap.instanceM[i] * mesh.model;
+      glUniformMatrix4fv(uniMeshM, 1, GL_FALSE, value_ptr(M));
+      drawMesh(mesh);
+    }
+
+    // rigid bodies
+    for (size_t i = 0; i < snap.bodyM.size(); i++) {
+      glUniformMatrix4fv(uniMeshM, 1, GL_FALSE, value_ptr(snap.bodyM[i]));
+      drawMesh(monkey);
+    }
 
     /* save frames */
+    // encoded and written to ./result/output%04d.bmp by other threads
     if (saveTrigger) {
-      string dir = "./result/output";
-      // zero padding
-      // e.g. "output0001.bmp"
-      string num = to_string(frameNumber);
-      num = string(4 - num.length(), '0') + num;
-      string output = dir + num + ".bmp";
-
-      // must use WINDOW_WIDTH * 2 and WINDOW_HEIGHT * 2 on OSX
-      // maybe because of the retina display
-      FIBITMAP *outputImage =
-          FreeImage_AllocateT(FIT_UINT32, WINDOW_WIDTH * 2, WINDOW_HEIGHT * 2);
-      glReadPixels(0, 0, WINDOW_WIDTH * 2, WINDOW_HEIGHT * 2, GL_BGRA,
-                   GL_UNSIGNED_INT_8_8_8_8_REV,
-                   (GLvoid *)FreeImage_GetBits(outputImage));
-      FreeImage_Save(FIF_BMP, outputImage, output.c_str(), 0);
-      std::cout << output << " saved." << '\n';
-      frameNumber++;
+      frameCapture.capture();
     }
     /* end save frames */
 
@@ -206,27 +304,25 @@ void initMatrix() {
       perspective(initialFoV, 1.f * WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 10.f);
 }
 
+// buffers for the particles loaded from particles.txt
 void initParticles() {
-  loadPoints(particles, "particles.txt");
-
   // create buffer
-  int nOfPs = particles.Ps.size();
+  ParticleSoA &state = particles.state;
+  int nOfPs = state.size();
   GLfloat *aPos = new GLfloat[nOfPs * 3];
   GLfloat *aColor = new GLfloat[nOfPs * 3];
 
   // implant data
   for (size_t i = 0; i < nOfPs; i++) {
-    Point &p = particles.Ps[i];
-
     // positions
-    aPos[i * 3 + 0] = p.pos.x;
-    aPos[i * 3 + 1] = p.pos.y;
-    aPos[i * 3 + 2] = p.pos.z;
+    aPos[i * 3 + 0] = state.x[i];
+    aPos[i * 3 + 1] = state.y[i];
+    aPos[i * 3 + 2] = state.z[i];
 
     // colors
-    aColor[i * 3 + 0] = p.color.r;
-    aColor[i * 3 + 1] = p.color.g;
-    aColor[i * 3 + 2] = p.color.b;
+    aColor[i * 3 + 0] = 0.5f;
+    aColor[i * 3 + 1] = 0.5f;
+    aColor[i * 3 + 2] = 0.5f;
   }
 
   // initialize buffer objects
@@ -253,89 +349,116 @@ void initParticles() {
 }
 
 void initMesh() {
-  mesh = loadObj("./mesh/bunny.obj");
-  createMesh(mesh);
-
-  findAABB(mesh);
-
   // transform mesh to (origin + offset) position
   vec3 offset = (gridOrigin - mesh.min) + rangeOffset;
-  mesh.translate(offset + vec3(-grid.cellSize * 1.f));
-  updateMesh(mesh);
+  mesh.model = translate(mat4(1.f), offset + vec3(-grid.cellSize * 1.f));
 }
 
-void releaseResource() { glfwTerminate(); }
-
-void step() {
-  int nOfPs = particles.Ps.size();
-
-  for (size_t i = 0; i < nOfPs; i++) {
-    Point &p = particles.Ps[i];
+void releaseResource() {
+  simRunning = false;
+  if (simThread.joinable()) {
+    simThread.join();
+  }
 
-    p.v += dt * g;
+  // wait for the frames in flight
+  frameCapture.finish();
+  frameWriter.finish();
+  std::cout << frameWriter.nOfWritten << " frames saved." << '\n';
 
-    // collision detection
-    float dist = grid.getDistance(p.pos);
+  glfwTerminate();
+}
 
-    if (dist < 0.1f) {
-      vec3 n = grid.getGradient(p.pos);
+void step() {
+  double start = glfwGetTime();
+
+  updateScene();
+
+  collideParticles(particles.state, spatialHash, simParams, getThreadPool());
+  stepParticlesParallel(particles.state, scene, simParams, getThreadPool());
+  stepNumber++;
+  recorder.push(particles.state, stepNumber);
+
+  rigidParams.dt = simParams.dt;
+  generateContacts(bodies, shapes, scene, rigidParams.margin, contacts,
+                   getThreadPool());
+  stepRigidBodies(bodies, shapes, contacts, rigidParams, getThreadPool());
+
+  // report throughput every 100 steps
+  stepTime += glfwGetTime() - start;
+  nOfTimedSteps++;
+  if (nOfTimedSteps == 100) {
+    double rate = particles.state.size() * nOfTimedSteps / stepTime;
+    std::cout << "step: " << rate << " particles/s on "
+              << getThreadPool().size() << " threads" << '\n';
+    stepTime = 0.0;
+    nOfTimedSteps = 0;
+  }
+}
 
-      vec3 vVer = -dot(p.v, -n) * (-n);
-      vec3 vHor = p.v - dot(p.v, -n) * (-n);
+// Fixed time step, decoupled from the display rate:
+// real time is accumulated, and consumed in steps of simParams.dt.
+void simLoop() {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point last = Clock::now();
+  double accumulator = 0.0;
+
+  while (simRunning) {
+    Clock::time_point now = Clock::now();
+    accumulator += std::chrono::duration<double>(now - last).count();
+    last = now;
+
+    int nOfSteps = 0;
+    double stepDt; // the key callback may change dt once the lock is gone
+    {
+      std::lock_guard<std::mutex> lock(simMtx);
+      stepDt = simParams.dt;
+      while (accumulator >= simParams.dt && nOfSteps < maxStepsPerUpdate) {
+        step();
+        accumulator -= simParams.dt;
+        nOfSteps++;
+      }
 
-      // float mu = 0.55f;
-      // if (length(vHor) < -mu * length(vVer)) {
-      //   p.v = vec3(0);
-      // } else {
-      //   p.v = vHor + mu * length(vVer) * normalize(vVer);
-      // }
-      float fric = 0.3f;
-      p.v = (vVer + vHor) * fric;
+      // too slow for real time, drop the backlog
+      if (nOfSteps == maxStepsPerUpdate) {
+        accumulator = std::min(accumulator, double(simParams.dt));
+      }
     }
 
-    // update position
-    p.pos += dt * p.v;
-
-    // if a particle has moved into an object
-    // push it out
-    float newDist = grid.getDistance(p.pos);
-    if (newDist < 0.f) {
-      newDist *= 2.f; // for visualization convenience
-      vec3 newGrad = grid.getGradient(p.pos);
-      p.pos += newDist * newGrad;
+    if (nOfSteps > 0) {
+      publishSnapshot();
+    } else {
+      std::this_thread::sleep_for(
+          std::chrono::duration<double>(stepDt - accumulator));
     }
-
-  } // end iterating particles
+  }
 }
 
-void loadPoints(Particles &pars, const string fileName) {
-  // read point information from file
-  ifstream ifs(fileName);
-
-  while (ifs.peek() != EOF) {
-    float x, y, z;
-
-    ifs >> x;
-    ifs >> y;
-    ifs >> z;
-
-    // ignore '\n'
-    // otherwise, the last empty line will be read
-    ifs.ignore(1);
-
-    Point p;
-    p.pos = vec3(x, y, z);
-    p.color = vec3(0.5, 0.5, 0.5);
-    p.v = vec3(randf() - 0.5f, randf() - 0.5f, randf() - 0.5f);
-    p.m = randf();
-
-    // transform
-    p.pos += vec3(0, 4.f, 0);
+// copy what the render thread draws
+void publishSnapshot() {
+  Snapshot &snap = snapshots.getBack();
+  const ParticleSoA &state = particles.state;
+
+  snap.x.assign(state.x.begin(), state.x.end());
+  snap.y.assign(state.y.begin(), state.y.end());
+  snap.z.assign(state.z.begin(), state.z.end());
+
+  snap.instanceM.resize(scene.instances.size());
+  for (size_t i = 0; i < scene.instances.size(); i++) {
+    const ColliderInstance &inst = scene.instances[i];
+    snap.instanceM[i] = glm::translate(mat4(1.f), inst.translation) *
+                        mat4_cast(inst.rotation) *
+                        glm::scale(mat4(1.f), vec3(inst.scale));
+  }
 
-    pars.Ps.push_back(p);
+  snap.bodyM.resize(bodies.size());
+  for (size_t i = 0; i < bodies.size(); i++) {
+    const RigidBody &body = bodies[i];
+    snap.bodyM[i] = glm::translate(mat4(1.f), body.pos) *
+                    mat4_cast(body.rot) *
+                    glm::translate(mat4(1.f), -shapes[body.shape].center);
   }
 
-  ifs.close();
+  snapshots.publish();
 }
 
 void computeMatricesFromInputs() {
@@ -423,6 +546,36 @@ void keyCallback(GLFWwindow *keyWnd, int key, int scancode, int action,
       saveTrigger = !saveTrigger;
       break;
     }
+    case GLFW_KEY_U: {
+      // switch between the persistently mapped and the plain upload
+      particles.persistent = !particles.persistent;
+      std::cout << "persistent particle upload: " << particles.persistent
+                << '\n';
+      break;
+    }
+    case GLFW_KEY_R: {
+      if (!loader.isDone()) {
+        break;
+      }
+      std::lock_guard<std::mutex> lock(simMtx);
+      if (recorder.isOpen()) {
+        recorder.close();
+        std::cout << "recorded " << recorder.nOfFrames << " frames" << '\n';
+      } else {
+        recorder.open("./result/trajectory.sdfr", particles.state.size());
+        std::cout << "recording to ./result/trajectory.sdfr" << '\n';
+      }
+      break;
+    }
+    case GLFW_KEY_C: {
+      // continuous collision detection allows a larger time step
+      std::lock_guard<std::mutex> lock(simMtx);
+      simParams.continuous = !simParams.continuous;
+      simParams.dt = simParams.continuous ? dt * 5.f : dt;
+      std::cout << "continuous collision: " << simParams.continuous
+                << ", dt = " << simParams.dt << '\n';
+      break;
+    }
     default:
       break;
     }
@@ -466,95 +619,6 @@ void initUniform() {
   glUniform3fv(uniEyePoint, 1, value_ptr(eyePoint));
 }
 
-void readSdf(Grid &gd, const string fileName) {
-  ifstream fin;
-  fin.open(fileName.c_str());
-
-  if (!(fin.good())) {
-    cout << "failed to open file : " << fileName << std::endl;
-  }
-
-  // read file
-  while (fin.peek() != EOF) {
-    Cell cell;
-
-    fin >> cell.pos.x;
-    fin >> cell.pos.y;
-    fin >> cell.pos.z;
-
-    fin >> cell.idx.x;
-    fin >> cell.idx.y;
-    fin >> cell.idx.z;
-
-    fin >> cell.sd;
-
-    gd.cells.push_back(cell);
-  } // end read file
-
-  // std::cout << "cells.size()" << gd.cells.size() << '\n';
-
-  fin.close();
-}
-
-// SDF generated by SDFGen
-// from https://github.com/christopherbatty
-// note that the <padding> parameter translates the mesh
-// with (dx * padding)
-void readSdfBatty(Grid &gd, const string fileName) {
-  ifstream fin;
-  fin.open(fileName.c_str());
-
-  if (!(fin.good())) {
-    cout << "failed to open file : " << fileName << std::endl;
-  }
-
-  // # of cells
-  fin >> gd.nOfCells.x;
-  fin >> gd.nOfCells.y;
-  fin >> gd.nOfCells.z;
-
-  // origin
-  fin >> gd.origin.x;
-  fin >> gd.origin.y;
-  fin >> gd.origin.z;
-  // assume the origin is always (0, 0, 0)
-  gd.origin = vec3(0);
-
-  // cell size
-  fin >> gd.cellSize;
-
-  // read sdf
-  for (size_t k = 0; k < gd.nOfCells.z; k++) {
-    for (size_t j = 0; j < gd.nOfCells.y; j++) {
-      for (size_t i = 0; i < gd.nOfCells.x; i++) {
-        Cell cell;
-
-        cell.pos = vec3(i * gd.cellSize, j * gd.cellSize, k * gd.cellSize);
-        cell.pos += gd.origin;
-
-        // if padding is 1
-        // cell.pos += vec3(gd.cellSize * 1.f);
-        // or translate the mesh instead
-
-        cell.idx = ivec3(i, j, k);
-
-        fin >> cell.sd;
-
-        gd.cells.push_back(cell);
-      }
-    }
-  }
-
-  fin.close();
-}
-
-float randf() {
-  // [0, 1]
-  float f = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-
-  return f;
-}
-
 void initGrid() {
   // vec3 gridSize = (mesh.max + rangeOffset) - gridOrigin;
   // nOfCells = ivec3(gridSize / cellSize);
@@ -565,7 +629,53 @@ void initGrid() {
   //
   // readSdf(grid, "sdfCube.txt");
 
-  readSdfBatty(grid, "sdfBunnyBatty.txt");
+  readSdfCached(grid, "sdfBunnyBatty.txt", readSdfBatty, "batty", cache);
 }
 
-void initOther() { srand(clock()); }
+void initOther() { srand(seed); }
+
+// a few copies of the bunny around the original one
+void initScene() {
+  vec3 size = vec3(grid.nOfCells) * grid.cellSize;
+
+  scene.addInstance(&grid, quat(1.f, 0.f, 0.f, 0.f), vec3(0.f), 1.f);
+  scene.addInstance(&grid, angleAxis(1.57f, vec3(0.f, 1.f, 0.f)),
+                    vec3(size.x * 1.5f, 0.f, 0.f), 0.8f);
+  scene.addInstance(&grid, angleAxis(3.14f, vec3(0.f, 1.f, 0.f)),
+                    vec3(0.f, 0.f, -size.z * 0.5f), 1.2f);
+  spinningInstance =
+      scene.addInstance(&grid, quat(1.f, 0.f, 0.f, 0.f),
+                        vec3(-size.x * 1.2f, 0.f, 0.f), 1.f);
+
+  scene.build();
+}
+
+// spin one instance about the center of its grid
+void updateScene() {
+  static float angle = 0.f;
+  angle += simParams.dt;
+
+  vec3 center = grid.origin + 0.5f * vec3(grid.nOfCells) * grid.cellSize;
+  quat q = angleAxis(angle, vec3(0.f, 1.f, 0.f));
+  vec3 t = vec3(-grid.nOfCells.x * grid.cellSize * 1.2f, 0.f, 0.f);
+
+  scene.setTransform(spinningInstance, q, t + center - q * center, 1.f);
+  scene.refit();
+}
+
+// monkeys dropped onto the bunnies in layers of 4 x 4
+void initBodies() {
+  vec3 size = vec3(grid.nOfCells) * grid.cellSize;
+
+  for (int i = 0; i < nOfBodies; i++) {
+    RigidBody body;
+    body.shape = 0;
+    body.pos = grid.origin + vec3((i % 4 + 0.5f) * size.x / 4.f,
+                                  size.y + 1.f + (i / 16) * 1.f,
+                                  ((i / 4) % 4 + 0.5f) * size.z / 4.f);
+    body.rot = angleAxis(float(i), normalize(vec3(1.f, 1.f, 0.f)));
+    body.v = vec3(0.f);
+    body.w = vec3(0.f);
+    bodies.push_back(body);
+  }
+}
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include "sdf.h"
+#include "spatialHash.h"
+#include "recorder.h"
+#include "frameWriter.h"
+#include "sparseGrid.h"
+#include "sdfCache.h"
+
+// Runs the particle simulation of ./simulation without a window,
+// for benchmarking and batch runs.
+//
+// usage: simulationHeadless [nOfSteps] [dumpEvery] [nOfCopies] [recordFile]
+//                           [capture] [sparseFile]
+//   nOfSteps   : number of fixed time steps
+//   dumpEvery  : write the particle state every k steps, 0 to disable
+//   nOfCopies  : load particles.txt this many times for a larger workload
+//   recordFile : record every step to a binary trajectory, see replay
+//              : "" to disable
+//   capture    : 1 to draw every step into a synthetic frame and save it
+//                through FrameWriter, like simulation saves its window
+//   sparseFile : collide with a sparse field from "createSdf sparse"
+//                instead of sdfBunnyBatty.txt
+
+void initParticles();
+bool initGrid();
+void step();
+void report();
+void drawFrame(uint8_t *, int, int);
+
+float dt = 0.01;
+vec3 g(0, -9.8, 0);
+SimParams simParams = {dt, g, 0.1f, 0.3f, 0.05f, 500.f, 5.f, false};
+SpatialHash spatialHash;
+unsigned seed = 1; // same seed, same initial velocities
+ParticleSoA particles;
+Grid grid;
+SdfCache cache; // parsed fields, see sdfCache.h
+SparseGrid sparseGrid;
+string sparseFile = "";
+
+int nOfSteps = 1000;
+int dumpEvery = 0;
+int nOfCopies = 1;
+string dumpDir = "./result/state";
+string recordFile = "";
+Recorder recorder;
+bool captureTrigger = false;
+FrameWriter frameWriter;
+
+// for performance report
+vector<double> stepTimes; // seconds
+
+int main(int argc, char const *argv[]) {
+  if (argc > 1) {
+    nOfSteps = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    dumpEvery = atoi(argv[2]);
+  }
+  if (argc > 3) {
+    nOfCopies = std::max(atoi(argv[3]), 1);
+  }
+  if (argc > 4) {
+    recordFile = argv[4];
+  }
+  if (argc > 5) {
+    captureTrigger = atoi(argv[5]) != 0;
+  }
+  if (argc > 6) {
+    sparseFile = argv[6];
+  }
+
+  if (!initGrid()) {
+    return 1;
+  }
+  initParticles();
+
+  std::cout << particles.size() << " particles, " << nOfSteps << " steps, "
+            << getThreadPool().size() << " threads" << '\n';
+
+  if (recordFile != "") {
+    recorder.open(recordFile, particles.size());
+  }
+
+  if (captureTrigger) {
+    frameWriter.start("./result/headless", 400, 300);
+  }
+
+  stepTimes.reserve(nOfSteps);
+
+  for (int s = 0; s < nOfSteps; s++) {
+    auto start = std::chrono::steady_clock::now();
+    step();
+    recorder.push(particles, s + 1); // only copies, the writer encodes
+    auto end = std::chrono::steady_clock::now();
+    stepTimes.push_back(std::chrono::duration<double>(end - start).count());
+
+    // stands in for rendering and glReadPixels, not timed
+    if (captureTrigger) {
+      int b = frameWriter.acquire();
+      drawFrame(frameWriter.getPixels(b), frameWriter.width,
+                frameWriter.height);
+      frameWriter.submit(b);
+    }
+
+    // save state, not timed
+    if (dumpEvery > 0 && (s + 1) % dumpEvery == 0) {
+      // zero padding
+      // e.g. "state000100.txt"
+      string num = to_string(s + 1);
+      num = string(std::max(6 - int(num.length()), 0), '0') + num;
+      writeParticles(particles, dumpDir + num + ".txt");
+    }
+  }
+
+  recorder.close();
+  frameWriter.finish();
+  report();
+
+  return 0;
+}
+
+// every copy gets its own seed, so the copies spread apart
+void initParticles() {
+  for (int c = 0; c < nOfCopies; c++) {
+    loadParticles(particles, "particles.txt", vec3(0, 4.f, 0), seed + c);
+  }
+}
+
+bool initGrid() {
+  if (sparseFile != "") {
+    if (!readSparseSdf(sparseGrid, sparseFile)) {
+      return false;
+    }
+    std::cout << sparseGrid.nOfAllocated() << " bricks, "
+              << sparseGrid.memory() / 1048576.0 << " MB" << '\n';
+  } else {
+    readSdfCached(grid, "sdfBunnyBatty.txt", readSdfBatty, "batty",
+                  cache);
+  }
+
+  return true;
+}
+
+// particle-particle repulsion, then the particle step against a single
+// field (the grid, or the sparse grid if one was given); unlike step() in
+// simulation.cpp there are no collider instances and no rigid bodies
+void step() {
+  collideParticles(particles, spatialHash, simParams, getThreadPool());
+  if (sparseFile != "") {
+    stepParticlesParallel(particles, sparseGrid, simParams, getThreadPool());
+  } else {
+    stepParticlesParallel(particles, grid, simParams, getThreadPool());
+  }
+}
+
+// latency percentiles of a single step, and overall throughput
+void report() {
+  if (stepTimes.empty()) {
+    return;
+  }
+
+  vector<double> sorted = stepTimes;
+  std::sort(sorted.begin(), sorted.end());
+
+  double total = 0.0;
+  for (size_t i = 0; i < sorted.size(); i++) {
+    total += sorted[i];
+  }
+
+  // nearest rank
+  auto percentile = [&](double p) {
+    size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
+  };
+
+  std::cout << "step latency (ms): "
+            << "min " << sorted.front() * 1e3 << ", "
+            << "p50 " << percentile(50.0) * 1e3 << ", "
+            << "p90 " << percentile(90.0) * 1e3 << ", "
+            << "p99 " << percentile(99.0) * 1e3 << ", "
+            << "max " << sorted.back() * 1e3 << '\n';
+  std::cout << "mean " << total / sorted.size() * 1e3 << " ms, "
+            << particles.size() * sorted.size() / total << " particles/s"
+            << '\n';
+
+  if (recordFile != "") {
+    std::cout << "recorded " << recorder.nOfFrames << " frames, "
+              << recorder.nOfBytes << " bytes, " << recorder.nOfStalls
+              << " stalls to " << recordFile << '\n';
+  }
+
+  if (captureTrigger) {
+    std::cout << "saved " << frameWriter.nOfWritten << " frames, "
+              << frameWriter.nOfStalls << " stalls" << '\n';
+  }
+}
+
+// particles as white dots on black, seen along -z
+// BGRA, rows bottom-up
+void drawFrame(uint8_t *pixels, int width, int height) {
+  std::fill(pixels, pixels + size_t(width) * height * 4, 0);
+
+  // the view covers [-1, 5] x [-1, 3.5]
+  float scale = width / 6.f;
+  for (size_t i = 0; i < particles.size(); i++) {
+    int px = int((particles.x[i] + 1.f) * scale);
+    int py = int((particles.y[i] + 1.f) * scale);
+    if (px < 0 || py < 0 || px >= width || py >= height) {
+      continue;
+    }
+
+    uint8_t *p = pixels + (size_t(py) * width + px) * 4;
+    p[0] = p[1] = p[2] = p[3] = 255;
+  }
+}
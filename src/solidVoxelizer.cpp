@@ -44,8 +44,19 @@ void releaseResource();
 
 void writePointCloud(vector<vec3> &, const string);
 vec3 calCellPos(vec3);
+void voxelizeScanline(Mesh &, vector<char> &);
 
 int main(int argc, char const *argv[]) {
+  // solidVoxelizer          : cells whose sdf against every triangle is
+  //                           negative, to test.txt
+  // solidVoxelizer edt [cellSize]
+  //                         : cells inside by scanline fill, then the
+  //                           distance transform of them to sdfEdt.txt
+  string mode = (argc > 1) ? argv[1] : "";
+  if (mode == "edt" && argc > 2) {
+    cellSize = float(atof(argv[2]));
+  }
+
   initGL();
   initShader();
   initMatrix();
@@ -141,53 +152,88 @@ int main(int argc, char const *argv[]) {
   // } // end iterate triangles
   /* end of test */
 
-  // for the selected range
-  for (float z = startCell.z; z < endCell.z; z += cellSize) {
-    for (float y = startCell.y; y < endCell.y; y += cellSize) {
-      for (float x = startCell.x; x < endCell.x; x += cellSize) {
-        vec3 P(x, y, z); // cell position
-        float dist = 9999.f;
-
-        // iterate triangles in the mesh
-        for (size_t i = 0; i < mesh.faces.size(); i++) {
-          Face face = mesh.faces[i];
-
-          glm::vec3 A, B, C, N;
-          A = mesh.vertices[face.v1];
-          B = mesh.vertices[face.v2];
-          C = mesh.vertices[face.v3];
-          N = mesh.faceNormals[face.vn1];
-
-          float temp = distPoint2Triangle(A, B, C, N, P);
-          float oldDist = dist;
-
-          // for general case
-          dist = (glm::abs(temp) < glm::abs(dist)) ? temp : dist;
-
-          // for a special case
-          float delta = abs(abs(temp) - abs(oldDist));
-          // if delta is less than some threshold
-          // we decide that temp is equal to dist
-          if (delta < 0.0001f) {
-
-            // if dist will change its sign
-            // we keep dist at the positive one
-            dist = (temp > 0) ? temp : oldDist;
-          }
+  if (mode == "edt") {
+    // the occupancy alone is enough to build an approximate sdf,
+    // without any point-triangle test
+    double start = glfwGetTime();
+    vector<char> occupancy;
+    voxelizeScanline(mesh, occupancy);
+    double voxelized = glfwGetTime();
+
+    Grid grid;
+    grid.origin = gridOrigin;
+    grid.cellSize = cellSize;
+    grid.nOfCells = nOfCells;
+    distanceTransform(grid, occupancy);
+    double transformed = glfwGetTime();
+
+    for (size_t i = 0; i < occupancy.size(); i++) {
+      if (occupancy[i]) {
+        pointCloud.push_back(grid.cells[i].pos);
+      }
+    }
 
-        } // end iterate triangles
+    writeSdf(grid, "sdfEdt.txt");
+    std::cout << nOfCells.x << " x " << nOfCells.y << " x " << nOfCells.z
+              << " cells, voxelized in " << voxelized - start
+              << " s, distance transform in " << transformed - voxelized
+              << " s, written to sdfEdt.txt" << '\n';
+  } else {
+    // for the selected range
+    for (float z = startCell.z; z < endCell.z; z += cellSize) {
+      for (float y = startCell.y; y < endCell.y; y += cellSize) {
+        for (float x = startCell.x; x < endCell.x; x += cellSize) {
+          vec3 P(x, y, z); // cell position
+          float dist = 9999.f;
+
+          // iterate triangles in the mesh
+          for (size_t i = 0; i < mesh.faces.size(); i++) {
+            Face face = mesh.faces[i];
+
+            glm::vec3 A, B, C, N;
+            A = mesh.vertices[face.v1];
+            B = mesh.vertices[face.v2];
+            C = mesh.vertices[face.v3];
+            N = mesh.faceNormals[face.vn1];
+
+            float temp = distPoint2Triangle(A, B, C, N, P);
+            float oldDist = dist;
+
+            // for general case
+            dist = (glm::abs(temp) < glm::abs(dist)) ? temp : dist;
+
+            // for a special case
+            float delta = abs(abs(temp) - abs(oldDist));
+            // if delta is less than some threshold
+            // we decide that temp is equal to dist
+            if (delta < 0.0001f) {
+
+              // if dist will change its sign
+              // we keep dist at the positive one
+              dist = (temp > 0) ? temp : oldDist;
+            }
+
+          } // end iterate triangles
+
+          // use sdf3d as a solid voxelier
+          // if dist < threshold, output grid position
+          float threshold = 0.f;
+          if (dist < threshold) {
+            pointCloud.push_back(P);
+          }
+        } // end x direction
+      }   // end y direction
+    }     // end z direction
 
-        // use sdf3d as a solid voxelier
-        // if dist < threshold, output grid position
-        float threshold = 0.f;
-        if (dist < threshold) {
-          pointCloud.push_back(P);
-        }
-      } // end x direction
-    }   // end y direction
-  }     // end z direction
+    writePointCloud(pointCloud, "test.txt");
+  }
 
-  writePointCloud(pointCloud, "test.txt");
+  // the voxels, as points
+  vector<Point> pts(pointCloud.size());
+  for (size_t i = 0; i < pointCloud.size(); i++) {
+    pts[i].pos = pointCloud[i];
+    pts[i].color = vec3(1.f, 1.f, 1.f);
+  }
 
   /* glfw loop */
   // a rough way to solve cursor position initialization problem
@@ -246,6 +292,98 @@ void writePointCloud(vector<vec3> &pointCloud, const string fileName) {
   output.close();
 }
 
+// twice the signed area of (u, v, p) in the yz plane, exactly negated when
+// u and v are swapped, so a point on an edge shared by two triangles is
+// decided the same way for both
+static double edgeYz(vec3 u, vec3 v, vec3 p) {
+  bool swapped = (u.y > v.y) || (u.y == v.y && u.z > v.z);
+  if (swapped) {
+    std::swap(u, v);
+  }
+
+  double e = (double(v.y) - u.y) * (double(p.z) - u.z) -
+             (double(v.z) - u.z) * (double(p.y) - u.y);
+  return swapped ? -e : e;
+}
+
+// a point exactly on the edge belongs to one side of it only
+static bool onInside(double e, vec3 u, vec3 v) {
+  return e > 0.0 || (e == 0.0 && (v.z > u.z || (v.z == u.z && v.y > u.y)));
+}
+
+// Cells inside the mesh by parity along x. Every triangle records the x at
+// which it crosses the rows whose (y, z) falls into its projection, then
+// each row is filled between pairs of crossings. The cost is the number of
+// cells plus the number of crossings, instead of cells times triangles.
+// The mesh must be closed; a row with an odd number of crossings is
+// filled up to its last pair only.
+void voxelizeScanline(Mesh &mesh, vector<char> &occupancy) {
+  ivec3 n = nOfCells;
+  vector<vector<float>> crossings(size_t(n.y) * n.z);
+
+  for (size_t f = 0; f < mesh.faces.size(); f++) {
+    Face &face = mesh.faces[f];
+
+    // in cells of the grid
+    vec3 a = (mesh.vertices[face.v1] - gridOrigin) / cellSize;
+    vec3 b = (mesh.vertices[face.v2] - gridOrigin) / cellSize;
+    vec3 c = (mesh.vertices[face.v3] - gridOrigin) / cellSize;
+
+    // counterclockwise in the yz plane, triangles parallel to x are never
+    // crossed
+    double area = edgeYz(a, b, c);
+    if (area == 0.0) {
+      continue;
+    }
+    if (area < 0.0) {
+      std::swap(b, c);
+      area = -area;
+    }
+
+    vec3 lo = min(a, min(b, c));
+    vec3 hi = max(a, max(b, c));
+    int j0 = std::max(int(ceil(lo.y)), 0);
+    int j1 = std::min(int(floor(hi.y)), n.y - 1);
+    int k0 = std::max(int(ceil(lo.z)), 0);
+    int k1 = std::min(int(floor(hi.z)), n.z - 1);
+
+    for (int k = k0; k <= k1; k++) {
+      for (int j = j0; j <= j1; j++) {
+        vec3 p(0.f, float(j), float(k));
+        double ea = edgeYz(b, c, p);
+        double eb = edgeYz(c, a, p);
+        double ec = edgeYz(a, b, p);
+        if (!onInside(ea, b, c) || !onInside(eb, c, a) ||
+            !onInside(ec, a, b)) {
+          continue;
+        }
+
+        // barycentric interpolation of x
+        double x = (ea * a.x + eb * b.x + ec * c.x) / area;
+        crossings[j + size_t(n.y) * k].push_back(float(x));
+      }
+    }
+  }
+
+  occupancy.assign(size_t(n.x) * n.y * n.z, 0);
+
+  parallelFor(n.y * n.z, [&](int begin, int end) {
+    for (int row = begin; row < end; row++) {
+      vector<float> &xs = crossings[row];
+      std::sort(xs.begin(), xs.end());
+
+      // crossings to the left of cell i, inside if odd and closed later
+      size_t left = 0;
+      for (int i = 0; i < n.x; i++) {
+        while (left < xs.size() && xs[left] < float(i)) {
+          left++;
+        }
+        occupancy[i + size_t(n.x) * row] = (left % 2 == 1 && left < xs.size());
+      }
+    }
+  });
+}
+
 void initGL() { // Initialise GLFW
   if (!glfwInit()) {
     fprintf(stderr, "Failed to initialize GLFW\n");
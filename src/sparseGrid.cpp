@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include "binaryIo.h"
+#include "sparseGrid.h"
+
+/* Binary format */
+// header : magic "SDFS", version, origin, cellSize, nOfCells, band,
+//          nOfAllocated
+// index  : one int32 per brick, x fastest
+// coarse : one float per brick
+// bricks : brickVolume floats per allocated brick, x fastest
+// Multi-byte values are stored in the byte order of the machine.
+static const char sparseMagic[4] = {'S', 'D', 'F', 'S'};
+static const uint32_t sparseVersion = 1;
+
+/* Per-thread brick cache */
+// Neighboring queries almost always fall into the same brick, so every
+// thread remembers the last brick it looked up and skips the index then.
+typedef struct {
+  const SparseGrid *grid;
+  unsigned version;
+  int hash;
+  const float *data; // nullptr for an unallocated brick
+  float value;       // coarse value of an unallocated brick
+} BrickCache;
+
+static thread_local BrickCache brickCache = {nullptr, 0, -1, nullptr, 0.f};
+static std::atomic<unsigned> nextVersion(1);
+
+static inline int floorToInt(float f) {
+  int i = int(f);
+  return i - (f < float(i));
+}
+
+void SparseGrid::touch() { version = nextVersion++; }
+
+// every brick starts unallocated, on the outside
+void SparseGrid::init(vec3 o, float size, ivec3 n, float b) {
+  origin = o;
+  cellSize = size;
+  nOfCells = n;
+  nOfBricks = (n + ivec3(brickSize - 1)) >> brickShift;
+  band = b;
+
+  size_t nOfEntries = size_t(nOfBricks.x) * nOfBricks.y * nOfBricks.z;
+  index.assign(nOfEntries, -1);
+  coarse.assign(nOfEntries, band);
+  bricks.clear();
+
+  touch();
+}
+
+int SparseGrid::allocate(int hash) {
+  if (index[hash] >= 0) {
+    return index[hash];
+  }
+
+  int n = int(nOfAllocated());
+  bricks.resize(bricks.size() + brickVolume, coarse[hash]);
+  index[hash] = n;
+
+  touch();
+
+  return n;
+}
+
+size_t SparseGrid::memory() const {
+  return index.size() * sizeof(int) + coarse.size() * sizeof(float) +
+         bricks.size() * sizeof(float);
+}
+
+// distance at a cell inside the box
+inline float SparseGrid::lookup(ivec3 idx, bool &allocated) const {
+  BrickCache &cache = brickCache;
+  int hash = calBrickHash(idx >> brickShift);
+
+  if (cache.grid != this || cache.version != version || cache.hash != hash) {
+    int n = index[hash];
+    cache.grid = this;
+    cache.version = version;
+    cache.hash = hash;
+    cache.data = (n >= 0) ? bricks.data() + size_t(n) * brickVolume : nullptr;
+    cache.value = coarse[hash];
+  }
+
+  allocated = (cache.data != nullptr);
+  if (!allocated) {
+    return cache.value;
+  }
+
+  ivec3 local = idx & ivec3(brickSize - 1);
+  return cache.data[local.x + brickSize * (local.y + brickSize * local.z)];
+}
+
+float SparseGrid::getDistance(vec3 p) const {
+  float d;
+  getDistances(&p.x, &p.y, &p.z, &d, 1);
+  return d;
+}
+
+vec3 SparseGrid::getGradient(vec3 p) const {
+  vec3 n;
+  getGradients(&p.x, &p.y, &p.z, &n.x, &n.y, &n.z, 1);
+  return n;
+}
+
+void SparseGrid::getDistances(const float *px, const float *py,
+                              const float *pz, float *out, int n) const {
+  for (int i = 0; i < n; i++) {
+    ivec3 idx(floorToInt((px[i] - origin.x) / cellSize),
+              floorToInt((py[i] - origin.y) / cellSize),
+              floorToInt((pz[i] - origin.z) / cellSize));
+
+    bool inside = (idx.x >= 0) & (idx.x < nOfCells.x) & (idx.y >= 0) &
+                  (idx.y < nOfCells.y) & (idx.z >= 0) & (idx.z < nOfCells.z);
+
+    bool allocated;
+    out[i] = inside ? lookup(idx, allocated) : 9999.f;
+  }
+}
+
+// Central differences as in Grid::getGradients.
+// Inside an unallocated brick every cell has the same value, so the
+// differences are taken between neighboring bricks instead.
+void SparseGrid::getGradients(const float *px, const float *py,
+                              const float *pz, float *gx, float *gy,
+                              float *gz, int n) const {
+  for (int i = 0; i < n; i++) {
+    vec3 p(px[i], py[i], pz[i]);
+
+    float h = cellSize;
+    ivec3 idx = ivec3(floor((p - origin) / cellSize));
+    if (all(greaterThanEqual(idx, ivec3(0))) && all(lessThan(idx, nOfCells))) {
+      bool allocated;
+      lookup(idx, allocated);
+      h = allocated ? cellSize : cellSize * brickSize;
+    }
+
+    vec3 grad;
+    for (int axis = 0; axis < 3; axis++) {
+      vec3 offset(0.f);
+      offset[axis] = h;
+      grad[axis] = getDistance(p - offset) - getDistance(p + offset); // -grad
+    }
+
+    // flat, e.g. deep inside with no neighboring brick closer
+    float len = length(grad);
+    grad = (len > 0.f) ? grad / len : vec3(0.f);
+
+    gx[i] = grad.x;
+    gy[i] = grad.y;
+    gz[i] = grad.z;
+  }
+}
+
+void SparseGrid::getBounds(vec3 &boxMin, vec3 &boxMax) const {
+  boxMin = origin;
+  boxMax = origin + vec3(nOfCells) * cellSize;
+}
+
+// Sphere tracing as in Grid::traceSegment.
+// Coarse values never exceed the distance, so unallocated bricks are
+// crossed in steps of at least band.
+bool SparseGrid::traceSegment(vec3 p0, vec3 p1, float radius, float &toi,
+                              vec3 &normal) const {
+  vec3 seg = p1 - p0;
+
+  // clip the segment to the box
+  vec3 boxMin, boxMax;
+  getBounds(boxMin, boxMax);
+  float tMin = 0.f, tMax = 1.f;
+
+  for (int a = 0; a < 3; a++) {
+    if (glm::abs(seg[a]) < 1e-12f) {
+      if (p0[a] < boxMin[a] || p0[a] >= boxMax[a]) {
+        return false;
+      }
+    } else {
+      float t1 = (boxMin[a] - p0[a]) / seg[a];
+      float t2 = (boxMax[a] - p0[a]) / seg[a];
+      tMin = std::max(tMin, std::min(t1, t2));
+      tMax = std::min(tMax, std::max(t1, t2));
+    }
+  }
+
+  if (tMin > tMax) {
+    return false;
+  }
+
+  float slack = cellSize * 1.7320508f;
+  float minStep = 0.5f * cellSize;
+
+  float len = length(seg);
+  float t = tMin * len;
+  float tEnd = tMax * len;
+  float tSafe = t;
+  vec3 dir = (len > 0.f) ? seg / len : vec3(0.f);
+
+  while (true) {
+    vec3 p = p0 + dir * t;
+    float d = getDistance(p);
+
+    if (d < radius) {
+      // only motion into the surface is a hit, as in Grid::traceSegment
+      if (dot(seg, getGradient(p)) <= 0.f) { // the gradient points inward
+        if (t >= tEnd) {
+          return false;
+        }
+        tSafe = t;
+        t = std::min(t + minStep, tEnd);
+        continue;
+      }
+
+      vec3 contact = p0 + dir * tSafe;
+      toi = (len > 0.f) ? tSafe / len : 0.f;
+      normal = -getGradient(contact); // the gradient points into the object
+      return true;
+    }
+
+    if (t >= tEnd) {
+      return false;
+    }
+
+    tSafe = t;
+    t = std::min(t + std::max(d - radius - slack, minStep), tEnd);
+  }
+}
+
+void writeSparseSdf(const SparseGrid &gd, const string fileName) {
+  ofstream output(fileName, std::ios::binary);
+
+  if (!(output.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+    return;
+  }
+
+  output.write(sparseMagic, 4);
+  writeRaw(output, sparseVersion);
+  writeRaw(output, gd.origin);
+  writeRaw(output, gd.cellSize);
+  writeRaw(output, gd.nOfCells);
+  writeRaw(output, gd.band);
+  writeRaw(output, uint64_t(gd.nOfAllocated()));
+
+  writeArray(output, gd.index);
+  writeArray(output, gd.coarse);
+  writeArray(output, gd.bricks);
+
+  output.close();
+}
+
+bool readSparseSdf(SparseGrid &gd, const string fileName) {
+  ifstream fin(fileName, std::ios::binary);
+
+  if (!(fin.good())) {
+    cout << "failed to open file : " << fileName << std::endl;
+    return false;
+  }
+
+  char magic[4];
+  uint32_t version;
+  vec3 origin;
+  float cellSize, band;
+  ivec3 nOfCells;
+  uint64_t nOfAllocated;
+  fin.read(magic, 4);
+  readRaw(fin, version);
+  readRaw(fin, origin);
+  readRaw(fin, cellSize);
+  readRaw(fin, nOfCells);
+  readRaw(fin, band);
+  if (!readRaw(fin, nOfAllocated) || std::memcmp(magic, sparseMagic, 4) ||
+      version != sparseVersion) {
+    cout << "not a sparse sdf file : " << fileName << std::endl;
+    return false;
+  }
+
+  // The arrays must fill the rest of the file exactly. That is checked
+  // before init, so nothing is allocated beyond the size of the file.
+  uint64_t headerEnd = uint64_t(fin.tellg());
+  fin.seekg(0, std::ios::end);
+  uint64_t rest = uint64_t(fin.tellg()) - headerEnd;
+  fin.seekg(headerEnd);
+
+  int lo = std::min({nOfCells.x, nOfCells.y, nOfCells.z});
+  int hi = std::max({nOfCells.x, nOfCells.y, nOfCells.z});
+  bool valid = (cellSize > 0.f) && lo >= 1 &&
+               hi <= std::numeric_limits<int>::max() - SparseGrid::brickSize;
+
+  // one int32 and one float per brick, and every partial product stays
+  // below the size of the file, so none of them overflows
+  uint64_t nOfEntries = 1;
+  for (int a = 0; a < 3 && valid; a++) {
+    uint64_t n = (uint64_t(nOfCells[a]) + SparseGrid::brickSize - 1) >>
+                 SparseGrid::brickShift;
+    nOfEntries *= n;
+    valid = (nOfEntries * (sizeof(int) + sizeof(float)) <= rest);
+  }
+  valid = valid && nOfAllocated <= nOfEntries &&
+          nOfEntries * (sizeof(int) + sizeof(float)) +
+                  nOfAllocated * SparseGrid::brickVolume * sizeof(float) ==
+              rest;
+
+  if (!valid) {
+    cout << "corrupt sparse sdf file : " << fileName << std::endl;
+    return false;
+  }
+
+  gd.init(origin, cellSize, nOfCells, band);
+  gd.bricks.resize(nOfAllocated * SparseGrid::brickVolume);
+
+  if (!readArray(fin, gd.index) || !readArray(fin, gd.coarse) ||
+      !readArray(fin, gd.bricks)) {
+    cout << "truncated sparse sdf file : " << fileName << std::endl;
+    return false;
+  }
+
+  // every brick number must point into bricks
+  for (size_t h = 0; h < gd.index.size(); h++) {
+    if (gd.index[h] < -1 || gd.index[h] >= int64_t(nOfAllocated)) {
+      cout << "corrupt sparse sdf file : " << fileName << std::endl;
+      gd.init(vec3(0.f), 0.f, ivec3(0), 0.f);
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,175 @@
+#include "spatialHash.h"
+
+/* Member functions of SpatialHash */
+// Parallel counting sort of particle indices by bucket
+//   1. histogram of buckets, with atomic counters
+//   2. exclusive prefix sum of the histogram, by blocks
+//   3. scatter indices to their bucket ranges
+//   4. sort each bucket by index, so the result is deterministic
+void SpatialHash::build(const ParticleSoA &ps, float newCellSize,
+                        ThreadPool &pool) {
+  size_t n = ps.size();
+  cellSize = newCellSize;
+
+  // about two buckets per particle, only grows
+  size_t wanted = 1;
+  while (wanted < 2 * n) {
+    wanted *= 2;
+  }
+  if (wanted > tableSize) {
+    tableSize = wanted;
+    counts.reset(new std::atomic<unsigned>[tableSize]);
+    cellStart.resize(tableSize + 1);
+  }
+  if (keys.size() < n) {
+    keys.resize(n);
+    sorted.resize(n);
+  }
+
+  const size_t chunk = 16384;
+
+  // 1. histogram
+  pool.parallelFor(tableSize, chunk, [&](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; b++) {
+      counts[b].store(0, std::memory_order_relaxed);
+    }
+  });
+
+  pool.parallelFor(n, chunk, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      unsigned b = calBucket(calCellIdx(ps.getPos(i)));
+      keys[i] = b;
+      counts[b].fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+
+  // 2. prefix sum: sum every block, scan the block sums, then scan blocks
+  size_t nOfBlocks = size_t(pool.size()) * 4;
+  size_t blockSize = (tableSize + nOfBlocks - 1) / nOfBlocks;
+  blockSums.resize(nOfBlocks + 1);
+
+  pool.parallelFor(nOfBlocks, 1, [&](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; k++) {
+      unsigned sum = 0;
+      size_t last = std::min(tableSize, (k + 1) * blockSize);
+      for (size_t b = k * blockSize; b < last; b++) {
+        sum += counts[b].load(std::memory_order_relaxed);
+      }
+      blockSums[k + 1] = sum;
+    }
+  });
+
+  blockSums[0] = 0;
+  for (size_t k = 0; k < nOfBlocks; k++) {
+    blockSums[k + 1] += blockSums[k];
+  }
+
+  // counts becomes the write cursor of each bucket
+  pool.parallelFor(nOfBlocks, 1, [&](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; k++) {
+      unsigned offset = blockSums[k];
+      size_t last = std::min(tableSize, (k + 1) * blockSize);
+      for (size_t b = k * blockSize; b < last; b++) {
+        unsigned c = counts[b].load(std::memory_order_relaxed);
+        cellStart[b] = offset;
+        counts[b].store(offset, std::memory_order_relaxed);
+        offset += c;
+      }
+    }
+  });
+  cellStart[tableSize] = unsigned(n);
+
+  // 3. scatter
+  pool.parallelFor(n, chunk, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      unsigned s = counts[keys[i]].fetch_add(1, std::memory_order_relaxed);
+      sorted[s] = unsigned(i);
+    }
+  });
+
+  // 4. buckets hold a few particles, insertion sort is enough
+  pool.parallelFor(tableSize, chunk, [&](size_t begin, size_t end) {
+    for (size_t b = begin; b < end; b++) {
+      for (unsigned s = cellStart[b] + 1; s < cellStart[b + 1]; s++) {
+        unsigned idx = sorted[s];
+        unsigned t = s;
+        while (t > cellStart[b] && sorted[t - 1] > idx) {
+          sorted[t] = sorted[t - 1];
+          t--;
+        }
+        sorted[t] = idx;
+      }
+    }
+  });
+}
+
+// Soft repulsion between overlapping particles
+// Every particle gathers the velocity change caused by its neighbors from
+// the current state, then all changes are applied at once. No particle
+// writes another one's state, so the loop runs in parallel and the result
+// does not depend on the number of threads.
+void collideParticles(ParticleSoA &ps, SpatialHash &hash,
+                      const SimParams &params, ThreadPool &pool) {
+  if (params.radius <= 0.f) {
+    return;
+  }
+
+  size_t n = ps.size();
+  float diameter = 2.f * params.radius;
+
+  // a cell as large as the interaction range,
+  // so all neighbors are in the 27 surrounding cells
+  hash.build(ps, diameter, pool);
+
+  if (hash.dvx.size() < n) {
+    hash.dvx.resize(n);
+    hash.dvy.resize(n);
+    hash.dvz.resize(n);
+  }
+
+  const size_t chunk = 4096;
+
+  // walk particles in bucket order, neighbors of consecutive particles
+  // are mostly the same
+  pool.parallelFor(n, chunk, [&](size_t begin, size_t end) {
+    for (size_t s = begin; s < end; s++) {
+      unsigned i = hash.sorted[s];
+      vec3 pi = ps.getPos(i);
+      vec3 vi = ps.getVelocity(i);
+      vec3 dv(0.f);
+
+      hash.forEachNeighbor(ps, i, diameter, [&](unsigned j) {
+        vec3 d = pi - ps.getPos(j);
+        float len = length(d);
+        if (len == 0.f) {
+          return;
+        }
+        vec3 nij = d / len;
+
+        // spring along the normal, proportional to the overlap
+        float overlap = diameter - len;
+        float a = params.stiffness * overlap;
+
+        // only damp particles moving towards each other
+        float vn = dot(vi - ps.getVelocity(j), nij);
+        if (vn < 0.f) {
+          a -= params.damping * vn;
+        }
+
+        dv += params.dt * a * nij;
+      });
+
+      hash.dvx[i] = dv.x;
+      hash.dvy[i] = dv.y;
+      hash.dvz[i] = dv.z;
+    }
+  });
+
+  pool.parallelFor(n, chunk, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      ps.vx[i] += hash.dvx[i];
+      ps.vy[i] += hash.dvy[i];
+      ps.vz[i] += hash.dvz[i];
+    }
+  });
+}
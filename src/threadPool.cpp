@@ -0,0 +1,106 @@
+#include "threadPool.h"
+
+// set on pool workers, and on a caller while it runs a job
+// parallel loops nested inside a job run serially instead of deadlocking
+static thread_local bool insideJob = false;
+
+ThreadPool::ThreadPool(int nOfThreads)
+    : job(nullptr), jobSize(0), jobChunk(1), nextChunk(0), nOfActive(0),
+      generation(0), stopping(false) {
+  if (nOfThreads <= 0) {
+    nOfThreads = int(std::thread::hardware_concurrency());
+  }
+
+  // the caller is one of the threads
+  for (int i = 1; i < nOfThreads; i++) {
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+void ThreadPool::parallelFor(
+    size_t n, size_t chunk, const std::function<void(size_t, size_t)> &func) {
+  if (n == 0) {
+    return;
+  }
+  chunk = std::max(chunk, size_t(1));
+
+  // not worth waking anybody up
+  if (workers.empty() || n <= chunk || insideJob) {
+    for (size_t begin = 0; begin < n; begin += chunk) {
+      func(begin, std::min(begin + chunk, n));
+    }
+    return;
+  }
+
+  // one job at a time
+  std::lock_guard<std::mutex> dispatchLock(dispatchMtx);
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    job = &func;
+    jobSize = n;
+    jobChunk = chunk;
+    nextChunk = 0;
+    nOfActive = int(workers.size());
+    generation++;
+  }
+  wake.notify_all();
+
+  insideJob = true;
+  runChunks();
+  insideJob = false;
+
+  std::unique_lock<std::mutex> lock(mtx);
+  done.wait(lock, [this] { return nOfActive == 0; });
+  job = nullptr;
+}
+
+void ThreadPool::runChunks() {
+  while (true) {
+    size_t begin = nextChunk.fetch_add(1) * jobChunk;
+    if (begin >= jobSize) {
+      break;
+    }
+    (*job)(begin, std::min(begin + jobChunk, jobSize));
+  }
+}
+
+void ThreadPool::workerLoop() {
+  insideJob = true;
+  unsigned seen = 0;
+
+  while (true) {
+    std::unique_lock<std::mutex> lock(mtx);
+    wake.wait(lock, [&] { return stopping || generation != seen; });
+    if (stopping) {
+      return;
+    }
+    seen = generation;
+    lock.unlock();
+
+    runChunks();
+
+    lock.lock();
+    nOfActive--;
+    if (nOfActive == 0) {
+      done.notify_one();
+    }
+  }
+}
+
+ThreadPool &getThreadPool() {
+  static ThreadPool pool;
+  return pool;
+}
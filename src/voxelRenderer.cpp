@@ -0,0 +1,208 @@
+#include "voxelRenderer.h"
+#include "threadPool.h"
+
+// 6 faces * 2 triangles of a cube with half edge length h,
+// position then normal for every vertex
+static void buildCube(float h, vector<GLfloat> &data) {
+  static const int axes[6][3] = {{0, 1, 2}, {0, 1, 2}, {1, 2, 0},
+                                 {1, 2, 0}, {2, 0, 1}, {2, 0, 1}};
+  static const float corners[6][2] = {{-1, -1}, {1, -1}, {1, 1},
+                                      {-1, -1}, {1, 1},  {-1, 1}};
+  data.clear();
+
+  for (int f = 0; f < 6; f++) {
+    float side = (f % 2 == 0) ? 1.f : -1.f;
+    int n = axes[f][0], u = axes[f][1], v = axes[f][2];
+
+    for (int k = 0; k < 6; k++) {
+      // swap the corners on the negative side to keep the winding ccw
+      int c = (side > 0.f) ? k : 5 - k;
+      vec3 pos, normal(0.f);
+      pos[n] = side * h;
+      pos[u] = corners[c][0] * h;
+      pos[v] = corners[c][1] * h;
+      normal[n] = side;
+
+      data.insert(data.end(), {pos.x, pos.y, pos.z});
+      data.insert(data.end(), {normal.x, normal.y, normal.z});
+    }
+  }
+}
+
+void VoxelRenderer::init() {
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+
+  // cube, filled by build() once the cell size is known
+  glGenBuffers(1, &vboCube);
+  glBindBuffer(GL_ARRAY_BUFFER, vboCube);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 6, 0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 6,
+                        (GLvoid *)(sizeof(GLfloat) * 3));
+  glEnableVertexAttribArray(2);
+
+  // one offset per instance
+  glGenBuffers(1, &vboInstances);
+  glBindBuffer(GL_ARRAY_BUFFER, vboInstances);
+  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  glVertexAttribDivisor(1, 1);
+  glEnableVertexAttribArray(1);
+
+  glBindVertexArray(0);
+}
+
+void VoxelRenderer::build(const Grid &grid, float isovalue, float slice) {
+  ivec3 n = grid.nOfCells;
+  ivec3 nOfChunks = (n + ivec3(chunkSize - 1)) / chunkSize;
+  size_t total = size_t(nOfChunks.x) * nOfChunks.y * nOfChunks.z;
+
+  auto isShown = [&](int i, int j, int k) {
+    if (i < 0 || j < 0 || k < 0 || i >= n.x || j >= n.y || k >= n.z) {
+      return false;
+    }
+    const Cell &cell = grid.cells[i + n.x * (j + n.y * k)];
+    return cell.sd < isovalue && cell.pos.z <= slice;
+  };
+
+  // collect the visible cells of every chunk in parallel
+  vector<vector<GLfloat>> perChunk(total);
+
+  getThreadPool().parallelFor(total, 16, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      int cx = int(c % nOfChunks.x);
+      int cy = int((c / nOfChunks.x) % nOfChunks.y);
+      int cz = int(c / (size_t(nOfChunks.x) * nOfChunks.y));
+      ivec3 lo = ivec3(cx, cy, cz) * chunkSize;
+      ivec3 hi = min(lo + ivec3(chunkSize), n);
+
+      for (int k = lo.z; k < hi.z; k++) {
+        for (int j = lo.y; j < hi.y; j++) {
+          for (int i = lo.x; i < hi.x; i++) {
+            if (!isShown(i, j, k)) {
+              continue;
+            }
+
+            // surrounded on all sides, cannot be seen
+            if (isShown(i - 1, j, k) && isShown(i + 1, j, k) &&
+                isShown(i, j - 1, k) && isShown(i, j + 1, k) &&
+                isShown(i, j, k - 1) && isShown(i, j, k + 1)) {
+              continue;
+            }
+
+            vec3 p = grid.cells[i + n.x * (j + n.y * k)].pos;
+            perChunk[c].insert(perChunk[c].end(), {p.x, p.y, p.z});
+          }
+        }
+      }
+    }
+  });
+
+  // concatenate in chunk order
+  float h = grid.cellSize * 0.5f;
+  chunks.clear();
+  offsets.clear();
+
+  for (size_t c = 0; c < total; c++) {
+    const vector<GLfloat> &cells = perChunk[c];
+    if (cells.empty()) {
+      continue;
+    }
+
+    Chunk chunk;
+    chunk.first = GLint(offsets.size() / 3);
+    chunk.count = GLsizei(cells.size() / 3);
+    chunk.min = vec3(9999.f);
+    chunk.max = vec3(-9999.f);
+    for (size_t k = 0; k < cells.size(); k += 3) {
+      vec3 p(cells[k], cells[k + 1], cells[k + 2]);
+      chunk.min = min(chunk.min, p - h);
+      chunk.max = max(chunk.max, p + h);
+    }
+
+    chunks.push_back(chunk);
+    offsets.insert(offsets.end(), cells.begin(), cells.end());
+  }
+
+  // upload
+  vector<GLfloat> cube;
+  buildCube(h, cube);
+  glBindBuffer(GL_ARRAY_BUFFER, vboCube);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * cube.size(), cube.data(),
+               GL_STATIC_DRAW);
+
+  // the buffer only grows, smaller sets are written into it
+  glBindBuffer(GL_ARRAY_BUFFER, vboInstances);
+  if (size() > capacity) {
+    capacity = size();
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3 * capacity, NULL,
+                 GL_STATIC_DRAW);
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * offsets.size(),
+                  offsets.data());
+}
+
+// Planes of the view frustum, extracted from the rows of projection * view
+// A point p is inside if dot(plane.xyz, p) + plane.w >= 0 for all planes.
+static void extractPlanes(const mat4 &PV, vec4 planes[6]) {
+  vec4 rowX(PV[0][0], PV[1][0], PV[2][0], PV[3][0]);
+  vec4 rowY(PV[0][1], PV[1][1], PV[2][1], PV[3][1]);
+  vec4 rowZ(PV[0][2], PV[1][2], PV[2][2], PV[3][2]);
+  vec4 rowW(PV[0][3], PV[1][3], PV[2][3], PV[3][3]);
+
+  planes[0] = rowW + rowX;
+  planes[1] = rowW - rowX;
+  planes[2] = rowW + rowY;
+  planes[3] = rowW - rowY;
+  planes[4] = rowW + rowZ;
+  planes[5] = rowW - rowZ;
+}
+
+// the box is outside if its corner furthest along a plane normal is behind
+// that plane; boxes near the frustum corners may pass, which is harmless
+static bool isBoxVisible(const vec4 planes[6], vec3 min, vec3 max) {
+  for (int i = 0; i < 6; i++) {
+    vec3 n = vec3(planes[i]);
+    vec3 p(n.x > 0.f ? max.x : min.x, n.y > 0.f ? max.y : min.y,
+           n.z > 0.f ? max.z : min.z);
+    if (dot(n, p) + planes[i].w < 0.f) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Visible chunks that are next to each other in the buffer are merged into
+// one instanced draw. The instance attribute is pointed at the start of
+// every run, which works without base instance support (GL 4.2).
+void VoxelRenderer::draw(const mat4 &PV) {
+  vec4 planes[6];
+  extractPlanes(PV, planes);
+
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, vboInstances);
+
+  nOfDrawnChunks = 0;
+  size_t c = 0;
+  while (c < chunks.size()) {
+    if (!isBoxVisible(planes, chunks[c].min, chunks[c].max)) {
+      c++;
+      continue;
+    }
+
+    // extend the run while the next chunk is visible
+    GLint first = chunks[c].first;
+    GLsizei count = 0;
+    while (c < chunks.size() &&
+           isBoxVisible(planes, chunks[c].min, chunks[c].max)) {
+      count += chunks[c].count;
+      nOfDrawnChunks++;
+      c++;
+    }
+
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0,
+                          (GLvoid *)(sizeof(GLfloat) * 3 * first));
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, count);
+  }
+}